@@ -1,12 +1,22 @@
 #include <iostream>
+#include <sstream>
 
 #include "assembler.h"
 using namespace std;
 
+const int64_t MERL_COOKIE = 0x10000002;		// beq $0, $0, 2 - skips the module header
+const int64_t MERL_HEADER = 12;				// bytes before the code of a module
+const int64_t MERL_REL = 0x01;				// footer entry: relocate the word at an address
+const int64_t MERL_ESR = 0x11;				// footer entry: external symbol used at an address
+
+static const vector<vector<Token>> noProgram;
+
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
 // ~~~~~~~~~~~~~~~~~~~~ MAIN ASSEMBLERS METHOD (PUBLIC) ~~~~~~~~~~~~~~~~~~~ //
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
 
+Assembler::Assembler() : program(noProgram), symbolTable() {}
+
 Assembler::Assembler(const vector<vector<Token>> &program) : program(program), symbolTable() {}
 
 // Responsible for coordinating the entire assembler's operation
@@ -21,6 +31,48 @@ vector<int64_t> Assembler::assemble() {
 	return binary;
 }
 
+// Assemble instruction objects straight from a code generator, with no text in between -
+// 		the result is a MERL object module (header, code, then a footer relocating each
+// 		.word of a label, and recording each use of an imported symbol for the linker)
+vector<int64_t> Assembler::assemble(const vector<Instruction> &code) {
+	vector<int64_t> binary{MERL_COOKIE, 0, 0}, relocs, externs;
+	symbolTable.clear();
+	imports.clear();
+
+	// first pass - label addresses and imports
+	pc = 0;
+	for (auto &inst : code) {
+		if (inst.op == Op::labeldef) {
+			if (symbolTable.count(inst.label+":") > 0)
+				throw AssemblerException(ET::DuplicateLabel, inst.label);
+			symbolTable.emplace(inst.label+":", pc);
+		} else if (inst.op == Op::dotimport) {
+			imports.insert(inst.label);
+		} else if (inst.op != Op::note) {
+			++pc;
+		}
+	}
+
+	// second pass - machine code, gathering the footer entries
+	pc = 0;
+	for (auto &inst : code) {
+		if (inst.op == Op::labeldef || inst.op == Op::dotimport || inst.op == Op::note) continue;
+		++pc;
+		try {
+			binary.push_back(buildInstruction(inst, relocs, externs));
+		} catch (AssemblerException &e) {
+			e.tagLine(inst);
+			throw e;
+		}
+	}
+
+	binary[2] = 4 * binary.size();
+	binary.insert(binary.end(), relocs.begin(), relocs.end());
+	binary.insert(binary.end(), externs.begin(), externs.end());
+	binary[1] = 4 * binary.size();
+	return binary;
+}
+
 
 
 
@@ -120,6 +172,104 @@ int64_t Assembler::buildInstruction(const vector<Token>& tokLine, unsigned int i
 }
 
 
+// Same as above, for an instruction object - label immediates are resolved here, noting
+// 		the footer entries of the module for .word labels (relocations and imports)
+int64_t Assembler::buildInstruction(const Instruction &inst, vector<int64_t> &relocs, vector<int64_t> &externs) {
+	vector<pair<Token::Kind,int>> format;
+	int64_t word = Assembler::setupInstruction(format, inst.op);
+	int64_t addr = MERL_HEADER + 4 * (pc - 1);
+
+	if (format.empty())
+		throw AssemblerException(ET::InvalidOpCode, getOpName(inst.op));
+
+	for (auto &part : format) {
+		if (part.first == Token::REG) {
+			int reg = (part.second == 11) ? inst.d : (part.second == 21) ? inst.s : inst.t;
+			word = word | (buildRegister(reg, "$" + to_string(reg)) << part.second);
+
+		} else if (part.first != Token::INT) {
+			continue;
+
+		} else if (inst.label.empty()) {
+			word = word | buildImmediate(inst.imm, part.second, to_string(inst.imm));
+
+		} else if (symbolTable.count(inst.label+":") > 0) {
+			int64_t target = symbolTable[inst.label+":"];
+			if (part.second < 32) {
+				word = word | buildImmediate(target - pc, part.second, inst.label);
+			} else {
+				relocs.push_back(MERL_REL);
+				relocs.push_back(addr);
+				word = word | buildImmediate(MERL_HEADER + (target << 2), part.second, inst.label);
+			}
+
+		} else if (part.second == 32 && imports.count(inst.label) > 0) {
+			externs.push_back(MERL_ESR);
+			externs.push_back(addr);
+			externs.push_back(inst.label.size());
+			for (char c : inst.label) externs.push_back(c);
+
+		} else {
+			throw AssemblerException(ET::UndeclaredLabel, inst.label);
+		}
+	}
+	return word;
+}
+
+
+// Convert a scanned line of assembly into instruction objects - its label declarations, then
+// 		its instruction, if any (immediates naming a label keep the name, resolved when encoded)
+vector<Assembler::Instruction> Assembler::read(const vector<Token> &tokLine) {
+	vector<Instruction> insts;
+	unsigned int i = 0;
+
+	for (; i < tokLine.size() && tokLine[i].getKind() == Token::LABEL; ++i) {
+		const string &lexeme = tokLine[i].getLexeme();
+		insts.push_back(Instruction{Op::labeldef, 0, 0, 0, 0, lexeme.substr(0, lexeme.size()-1)});
+	}
+	if (i == tokLine.size()) return insts;
+
+	try {
+		if (tokLine[i].getKind() != Token::WORD && tokLine[i].getKind() != Token::ID)
+			throw AssemblerException(ET::NotOpCode, tokLine[i].getLexeme());
+
+		vector<pair<Token::Kind,int>> format;
+		Instruction inst{Assembler::getOpType(tokLine[i++].getLexeme()), 0, 0, 0, 0, ""};
+		Assembler::setupInstruction(format, inst.op);
+
+		if (format.empty())
+			throw AssemblerException(ET::InvalidOpCode, tokLine[i-1].getLexeme());
+		if (tokLine.size()-i < format.size())
+			throw AssemblerException(ET::MissingTokens);
+		if (tokLine.size()-i > format.size())
+			throw AssemblerException(ET::TooManyTokens);
+
+		for (unsigned int j = 0; j < format.size(); ++j, ++i) {
+			const Token &tok = tokLine[i];
+			if (tok.getKind() != format[j].first &&
+				(format[j].first != Token::INT || (tok.getKind() != Token::HEXINT && tok.getKind() != Token::ID)))
+				throw AssemblerException(ET::TokenMismatch, tok.getLexeme());
+
+			if (format[j].first == Token::REG) {
+				int reg = buildRegister(tok.toNumber(), tok.getLexeme());
+				if (format[j].second == 11) inst.d = reg;
+				else if (format[j].second == 21) inst.s = reg;
+				else inst.t = reg;
+			} else if (format[j].first == Token::INT) {
+				if (tok.getKind() == Token::ID) inst.label = tok.getLexeme();
+				else inst.imm = tok.toNumber();
+			}
+		}
+		insts.push_back(inst);
+
+	} catch (AssemblerException &e) {
+		e.tagLine(tokLine);
+		throw e;
+	}
+	return insts;
+}
+
+
 // Return corresponding opcode enumeration
 Assembler::Op Assembler::getOpType(const string& opcode) {
 	if (opcode == ".word")	return Op::dotword;
@@ -151,6 +301,40 @@ Assembler::Op Assembler::getOpType(const string& opcode) {
 }
 
 
+// Return corresponding opcode mnemonic
+string Assembler::getOpName(const Assembler::Op op) {
+	switch (op) {
+		case Op::dotword:	return ".word";
+
+		case Op::add:		return "add";
+		case Op::sub:		return "sub";
+		case Op::slt:		return "slt";
+		case Op::sltu:		return "sltu";
+
+		case Op::mult:		return "mult";
+		case Op::multu:		return "multu";
+		case Op::div:		return "div";
+		case Op::divu:		return "divu";
+
+		case Op::mfhi:		return "mfhi";
+		case Op::mflo:		return "mflo";
+		case Op::lis:		return "lis";
+
+		case Op::jr:		return "jr";
+		case Op::jalr:		return "jalr";
+
+		case Op::beq:		return "beq";
+		case Op::bne:		return "bne";
+
+		case Op::lw:		return "lw";
+		case Op::sw:		return "sw";
+
+		case Op::dotimport:	return ".import";
+		default:			return "";
+	}
+}
+
+
 // Provide the instruction's format specification sequence and return the base
 //		 template of the instruction (opcode, etc)
 int64_t Assembler::setupInstruction(vector<pair<Token::Kind,int>> &format, const Assembler::Op op) {
@@ -275,10 +459,12 @@ int64_t Assembler::buildToken(const Token& tok, const Token::Kind kind, const in
 // Pre: given REG token; Produce register opcode template
 // Check and produce register number for instruction (REG)
 int64_t Assembler::buildRegister(const Token& tok) {
-	int64_t reg = tok.toNumber();
-	
+	return buildRegister(tok.toNumber(), tok.getLexeme());
+}
+
+int64_t Assembler::buildRegister(int64_t reg, const string &lexeme) {
 	if (reg < 0 || reg > 31)
-		throw AssemblerException(ET::OutOfBoundsReg, tok.getLexeme());
+		throw AssemblerException(ET::OutOfBoundsReg, lexeme);
 	return reg;
 }
 
@@ -290,24 +476,94 @@ int64_t Assembler::buildImmediate(const Token& tok, int bc) {
 	if (tok.getKind() == Token::ID && symbolTable.count(tok.getLexeme()+":") == 0)
 		throw AssemblerException(ET::UndeclaredLabel, tok.getLexeme());
 
-	int64_t mask = 0;
 	int64_t imm = (tok.getKind() != Token::ID) ? tok.toNumber() :
 				  					 (bc < 32) ? (symbolTable[tok.getLexeme()+":"] - pc) :
 				  								 (symbolTable[tok.getLexeme()+":"] << 2);
+	return buildImmediate(imm, bc, tok.getLexeme());
+}
+
+// Check a resolved immediate fits in bc bits (either signed or unsigned), and mask it
+int64_t Assembler::buildImmediate(int64_t imm, int bc, const string &lexeme) {
+	int64_t mask = 0;
 
 	for (int i = 0; i < bc; ++i)
 		mask = (mask << 1) + 1;
 
 	if ((imm < 0) && (0-imm > ((mask >> 1)+1)))
-		throw AssemblerException(ET::OutOfBoundsImm, tok.getLexeme());
+		throw AssemblerException(ET::OutOfBoundsImm, lexeme);
 	if (imm > mask)
-		throw AssemblerException(ET::OutOfBoundsImm, tok.getLexeme());
+		throw AssemblerException(ET::OutOfBoundsImm, lexeme);
 	return (imm & mask);
 }
 
 
 
 
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~ INSTRUCTION OBJECTS ~~~~~~~~~~~~~~~~~~~~~~~~~ //
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+// Print an instruction object as a line of assembly text (notes are printed verbatim)
+ostream &operator<<(ostream &out, const Assembler::Instruction &inst) {
+	string imm = (inst.label.empty()) ? to_string(inst.imm) : inst.label;
+
+	switch (inst.op) {
+		case Assembler::labeldef:	return out << inst.label << ":" << '\n';
+		case Assembler::note:		return out << inst.label;
+		default:					break;
+	}
+
+	out << "\t\t" << Assembler::getOpName(inst.op);
+	switch (inst.op) {
+		case Assembler::dotword:
+		case Assembler::dotimport:
+			out << " " << imm;
+			break;
+
+		case Assembler::add:
+		case Assembler::sub:
+		case Assembler::slt:
+		case Assembler::sltu:
+			out << " $" << inst.d << ", $" << inst.s << ", $" << inst.t;
+			break;
+
+		case Assembler::mult:
+		case Assembler::multu:
+		case Assembler::div:
+		case Assembler::divu:
+			out << " $" << inst.s << ", $" << inst.t;
+			break;
+
+		case Assembler::mfhi:
+		case Assembler::mflo:
+		case Assembler::lis:
+			out << " $" << inst.d;
+			break;
+
+		case Assembler::jr:
+		case Assembler::jalr:
+			out << " $" << inst.s;
+			break;
+
+		case Assembler::beq:
+		case Assembler::bne:
+			out << " $" << inst.s << ", $" << inst.t << ", " << imm;
+			break;
+
+		case Assembler::lw:
+		case Assembler::sw:
+			out << " $" << inst.t << ", " << imm << "($" << inst.s << ")";
+			break;
+
+		default:
+			break;
+	}
+	return out << '\n';
+}
+
+
+
+
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ ERROR HANDLING ~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
@@ -340,4 +596,11 @@ void AssemblerException::tagLine(const vector<Token> &tokLine) {
 		msg += tok.getLexeme() + " ";
 }
 
+void AssemblerException::tagLine(const Assembler::Instruction &inst) {
+	ostringstream line;
+	line << inst;
+	msg += "\n\t ==> " + line.str().substr(line.str().find_first_not_of('\t'));
+	if (msg.back() == '\n') msg.pop_back();
+}
+
 const string& AssemblerException::what() const { return msg; }
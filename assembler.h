@@ -2,6 +2,8 @@
 #define ASSEMBLER_HEADER
 
 #include <cstdint>
+#include <ostream>
+#include <set>
 #include <string>
 #include <vector>
 #include <map>
@@ -14,10 +16,7 @@ class ET;
 
 // Assembler class definition
 class Assembler {
-	// Data Members
-	int64_t pc;
-	const std::vector<std::vector<Token>> &program;
-	std::map<std::string,int64_t> symbolTable;
+  public:
 	enum Op : int {
 		invalid=0,
 		dotword,
@@ -27,25 +26,55 @@ class Assembler {
 		jr, jalr,
 		lw, sw,
 		beq, bne,
+		// not machine instructions - label declarations, imports, and comments/spacing
+		labeldef, dotimport, note,
+	};
+
+	// Instruction object, handed over by a code generator in place of a line of text -
+	// 		registers sit in the field of their format position ($d, $s, $t), and an
+	// 		immediate names a label instead when label is set (labeldef, dotimport and
+	// 		note keep their name or text there too)
+	struct Instruction {
+		Op op;
+		int d, s, t;
+		int64_t imm;
+		std::string label;
 	};
 
+  private:
+	// Data Members
+	int64_t pc;
+	const std::vector<std::vector<Token>> &program;
+	std::map<std::string,int64_t> symbolTable;
+	std::set<std::string> imports;
+
 	// Helper Methods
 	int64_t buildInstruction(const std::vector<Token>&, unsigned int);
-	Op getOpType(const std::string&);
-	int64_t setupInstruction(std::vector<std::pair<Token::Kind,int>>&, const Op);
+	int64_t buildInstruction(const Instruction&, std::vector<int64_t>&, std::vector<int64_t>&);
+	static int64_t setupInstruction(std::vector<std::pair<Token::Kind,int>>&, const Op);
 	int64_t buildToken(const Token&, const Token::Kind, const int);
 	int64_t buildRegister(const Token&);
+	static int64_t buildRegister(int64_t, const std::string&);
 	int64_t buildImmediate(const Token&, int);
+	int64_t buildImmediate(int64_t, int, const std::string&);
 
 	// Major Methods
 	void checkPass();
 	void codeGenPass(std::vector<int64_t>&);
 
   public:
+	Assembler();
 	Assembler(const std::vector<std::vector<Token>>&);
 	std::vector<int64_t> assemble();
+	std::vector<int64_t> assemble(const std::vector<Instruction>&);
+
+	static std::vector<Instruction> read(const std::vector<Token>&);
+	static Op getOpType(const std::string&);
+	static std::string getOpName(const Op);
 };
 
+std::ostream &operator<<(std::ostream&, const Assembler::Instruction&);
+
 // Error Types
 class ET {
   public:
@@ -73,6 +102,7 @@ class AssemblerException {
   public:
 	AssemblerException(ET::ErrorType, std::string str = "");
 	void tagLine(const std::vector<Token>&);
+	void tagLine(const Assembler::Instruction&);
 	const std::string &what() const;
 };
 
@@ -210,6 +210,7 @@ class AsmDFA {
       registerTransition(START, "(", LPAREN);
       registerTransition(START, ")", RPAREN);
       registerTransition(ID, isalnum, ID);
+      registerTransition(ID, "_", ID);
       registerTransition(ID, ":", LABEL);
       registerTransition(DOT, isalpha, DOTID);
       registerTransition(DOTID, isalpha, DOTID);
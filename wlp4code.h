@@ -0,0 +1,296 @@
+#ifndef WLP4CODE_H
+#define WLP4CODE_H
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "assembler.h"
+#include "scanner.h"
+#include "wlp4cycles.h"
+
+using Op = Assembler::Op;
+using Instruction = Assembler::Instruction;
+
+/** Generated code - a sequence of instruction objects, printed as MIPS assembly text, or **/
+/** handed straight to the assembler for machine code (no textual assembly in between) **/
+class Code {
+  public:
+	static const int FRAME = 32;		// pseudo base register of frame slots addressed from sp, until rebased
+
+  private:
+	std::vector<Instruction> insts;
+
+	void emit(Op op, int d, int s, int t, int64_t imm = 0, const std::string &label = "") {
+		insts.push_back(Instruction{op, d, s, t, imm, label});
+	}
+
+	/** unconditional jump - beq $0, $0, label **/
+	static bool is_jump(const Instruction &inst) {
+		return inst.op == Op::beq && inst.s == 0 && inst.t == 0 && !inst.label.empty();
+	}
+
+	/** first instruction from k on that takes up a word (not a label or comment) **/
+	size_t next(size_t k) const {
+		while (k < insts.size() && (insts[k].op == Op::labeldef || insts[k].op == Op::note)) ++k;
+		return k;
+	}
+
+	/** the instructions counted over by branches skipping a number of them, and those they skip to **/
+	std::vector<bool> skipped() const {
+		std::vector<bool> fixed(insts.size(), false);
+		for (size_t k = 0; k < insts.size(); ++k) {
+			const Instruction &inst = insts[k];
+			if ((inst.op != Op::beq && inst.op != Op::bne) || !inst.label.empty()) continue;
+			for (size_t j = k, n = 0; n <= (size_t) std::max<int64_t>(0, inst.imm) && j < insts.size(); ++n)
+				if ((j = next(j + 1)) < insts.size()) fixed[j] = true;
+		}
+		return fixed;
+	}
+
+	/** one pass dropping unreachable code and jumps to the next instruction - return whether any was **/
+	/** (instructions counted over by branches skipping a number of them are always kept) **/
+	bool drop(int &dropped) {
+		std::vector<bool> fixed = skipped();
+
+		std::vector<Instruction> kept;
+		bool reachable = true;
+		int before = dropped;
+		for (size_t k = 0; k < insts.size(); ++k) {
+			const Instruction &inst = insts[k];
+			if (inst.op == Op::labeldef || fixed[k]) reachable = true;
+			if (inst.op == Op::labeldef || inst.op == Op::note) {
+				kept.push_back(inst);
+				continue;
+			}
+			if (!reachable) {
+				++dropped;
+				continue;
+			}
+
+			/* a jump or branch to a label between it and the next instruction */
+			bool toNext = false;
+			if ((inst.op == Op::beq || inst.op == Op::bne) && !inst.label.empty() && !fixed[k]) {
+				for (size_t j = k + 1, end = next(k + 1); j < end; ++j)
+					toNext = toNext || (insts[j].op == Op::labeldef && insts[j].label == inst.label);
+			}
+			if (toNext) {
+				++dropped;
+				continue;
+			}
+			kept.push_back(inst);
+			if (is_jump(inst) || inst.op == Op::jr) reachable = false;
+		}
+		insts.swap(kept);
+		return dropped != before;
+	}
+
+	/** list-schedule one basic block (see schedule) onto the end of out **/
+	static void schedule_block(const CycleModel &model, std::vector<std::vector<Instruction>> &block,
+							   std::vector<Instruction> &out, int &saved) {
+		size_t n = block.size();
+		std::vector<std::vector<int>> reads(n), writes(n);
+		for (size_t i = 0; i < n; ++i) CycleModel::operands(block[i][0], reads[i], writes[i]);
+
+		/* dependences - i before j, at least the latency of i apart where j reads what i writes (or both */
+		/* use the multiply unit) */
+		auto shares = [](const std::vector<int> &a, const std::vector<int> &b) {
+			for (int r : a)
+				if (std::find(b.begin(), b.end(), r) != b.end()) return true;
+			return false;
+		};
+		std::vector<std::vector<std::pair<size_t,int>>> succs(n);
+		std::vector<int> preds(n, 0);
+		for (size_t j = 0; j < n; ++j) {
+			Op opJ = block[j][0].op;
+			for (size_t i = 0; i < j; ++i) {
+				Op opI = block[i][0].op;
+				bool memory = (opI == Op::sw && (opJ == Op::lw || opJ == Op::sw)) || (opI == Op::lw && opJ == Op::sw);
+				bool raw = shares(writes[i], reads[j]);
+				bool unit = std::find(writes[j].begin(), writes[j].end(), CycleModel::HI) != writes[j].end()
+						 && shares(writes[i], writes[j]);
+				if (raw || memory || shares(writes[i], writes[j]) || shares(reads[i], writes[j])) {
+					succs[i].emplace_back(j, (raw || unit) ? model.of(opI) : 1);
+					++preds[j];
+				}
+			}
+		}
+
+		/* priority - the longest chain of latencies from each instruction to the end of the block */
+		std::vector<long long> height(n, 1);
+		for (size_t i = n; i-- > 0; )
+			for (auto &succ : succs[i]) height[i] = std::max(height[i], succ.second + height[succ.first]);
+
+		std::vector<size_t> order;
+		std::vector<long long> earliest(n, 0);
+		std::vector<bool> done(n, false);
+		for (long long cycle = 0; order.size() < n; ++cycle) {
+			size_t best = n;
+			for (size_t i = 0; i < n; ++i) {
+				if (done[i] || preds[i] != 0) continue;
+				bool readyI = earliest[i] <= cycle;
+				if (best == n) {
+					best = i;
+					continue;
+				}
+				bool readyBest = earliest[best] <= cycle;
+				if ((readyI && !readyBest) || (readyI == readyBest && (readyI
+						? height[i] > height[best]
+						: earliest[i] < earliest[best] || (earliest[i] == earliest[best] && height[i] > height[best]))))
+					best = i;
+			}
+			cycle = std::max(cycle, earliest[best]);
+			done[best] = true;
+			order.push_back(best);
+			for (auto &succ : succs[best]) {
+				earliest[succ.first] = std::max(earliest[succ.first], cycle + succ.second);
+				--preds[succ.first];
+			}
+		}
+
+		std::vector<Instruction> before, after;
+		for (size_t i = 0; i < n; ++i) before.insert(before.end(), block[i].begin(), block[i].end());
+		for (size_t i : order) after.insert(after.end(), block[i].begin(), block[i].end());
+		long long gain = model.estimate(before) - model.estimate(after);
+		if (gain > 0) saved += gain;
+		out.insert(out.end(), (gain > 0) ? after.begin() : before.begin(), (gain > 0) ? after.end() : before.end());
+	}
+
+  public:
+	// R format
+	void op3(Op op, int d, int s, int t)	{ emit(op, d, s, t); }		// [op] $d, $s, $t
+	void op2(Op op, int s, int t)			{ emit(op, 0, s, t); }		// [op] $s, $t
+	void op1(Op op, int d)					{ emit(op, d, 0, 0); }		// [op] $d (mfhi, mflo, lis)
+	void add(int d, int s, int t)			{ op3(Op::add, d, s, t); }
+	void sub(int d, int s, int t)			{ op3(Op::sub, d, s, t); }
+	void mult(int s, int t)					{ op2(Op::mult, s, t); }
+	void mflo(int d)						{ op1(Op::mflo, d); }
+	void lis(int d)							{ op1(Op::lis, d); }
+	void jr(int s)							{ emit(Op::jr, 0, s, 0); }
+	void jalr(int s)						{ emit(Op::jalr, 0, s, 0); }
+
+	// I format
+	void branch(Op op, int s, int t, const std::string &label)	{ emit(op, 0, s, t, 0, label); }
+	void beq(int s, int t, const std::string &label)			{ branch(Op::beq, s, t, label); }
+	void bne(int s, int t, const std::string &label)			{ branch(Op::bne, s, t, label); }
+	void bne(int s, int t, int skip)							{ emit(Op::bne, 0, s, t, skip); }
+	void lw(int t, int imm, int s)								{ emit(Op::lw, 0, s, t, imm); }
+	void sw(int t, int imm, int s)								{ emit(Op::sw, 0, s, t, imm); }
+
+	// directives, labels and comments
+	void word(int64_t val)					{ emit(Op::dotword, 0, 0, 0, val); }
+	void word(const std::string &label)		{ emit(Op::dotword, 0, 0, 0, 0, label); }
+	void frame_word(int64_t offset)			{ emit(Op::dotword, 0, FRAME, 0, offset); }	// offset of a frame slot from sp
+	void import(const std::string &label)	{ emit(Op::dotimport, 0, 0, 0, 0, label); }
+	void label(const std::string &label)	{ emit(Op::labeldef, 0, 0, 0, 0, label); }
+	void note(const std::string &text)		{ emit(Op::note, 0, 0, 0, 0, text); }
+
+	void append(const Code &code) { insts.insert(insts.end(), code.insts.begin(), code.insts.end()); }
+
+	size_t size() const { return insts.size(); }
+
+	/** whether a register may hold another value than it did before instruction k - any instruction **/
+	/** from k on writing it, any label (code may be entered there) and any call **/
+	bool changed_since(size_t k, int reg) const {
+		std::vector<int> reads, writes;
+		for (; k < insts.size(); ++k) {
+			const Instruction &inst = insts[k];
+			if (inst.op == Op::labeldef || inst.op == Op::jalr) return true;
+			CycleModel::operands(inst, reads, writes);
+			if (std::find(writes.begin(), writes.end(), reg) != writes.end()) return true;
+		}
+		return false;
+	}
+
+	/** the last instruction taking up a word (not a label or comment) - a nop if there is none **/
+	Instruction last() const {
+		for (size_t k = insts.size(); k-- > 0; )
+			if (insts[k].op != Op::labeldef && insts[k].op != Op::note) return insts[k];
+		return Instruction{Op::add, 0, 0, 0, 0, ""};
+	}
+
+	/** clean up the block layout of one procedure - jumps and branches to a label that only jumps on **/
+	/** go straight to where it jumps, code after a jump (up to the next label) is dropped as **/
+	/** unreachable, and so are jumps and branches to the code right after them - counting the jumps **/
+	/** threaded and the instructions dropped **/
+	void layout(int &threaded, int &dropped) {
+		std::map<std::string,size_t> labels;
+		for (size_t k = 0; k < insts.size(); ++k)
+			if (insts[k].op == Op::labeldef) labels[insts[k].label] = k;
+
+		for (Instruction &inst : insts) {
+			if ((inst.op != Op::beq && inst.op != Op::bne) || inst.label.empty()) continue;
+			std::set<std::string> seen;
+			std::string target = inst.label;
+			while (labels.count(target) != 0 && seen.insert(target).second) {
+				size_t k = next(labels[target]);
+				if (k == insts.size() || !is_jump(insts[k])) break;
+				target = insts[k].label;
+			}
+			if (target != inst.label) {
+				inst.label = target;
+				++threaded;
+			}
+		}
+		while (drop(dropped)) {}
+	}
+
+	/** list-schedule each basic block to hide latencies under the cycle model - a block is a run of **/
+	/** instructions up to a label, comment, branch or jump (a lis taking its word along), within which **/
+	/** instructions keep their order only where they depend on each other through a register, HI and **/
+	/** LO, or memory (loads and stores keep their order with respect to stores); of the instructions **/
+	/** ready, the one heading the longest chain of latencies to the end of the block goes first - a **/
+	/** block is only reordered when that saves cycles, counted in saved **/
+	void schedule(const CycleModel &model, int &saved) {
+		std::vector<bool> fixed = skipped();
+		std::vector<Instruction> scheduled;
+		std::vector<std::vector<Instruction>> block;		// units of one or two instructions (lis and its word)
+		for (size_t k = 0; k <= insts.size(); ++k) {
+			bool inBlock = k < insts.size() && !fixed[k] && CycleModel::issues(insts[k])
+						 && insts[k].op != Op::beq && insts[k].op != Op::bne && insts[k].op != Op::jr && insts[k].op != Op::jalr;
+			if (inBlock && insts[k].op == Op::lis && (k + 1 == insts.size() || insts[k + 1].op != Op::dotword || fixed[k + 1]))
+				inBlock = false;
+			if (inBlock) {
+				block.push_back({insts[k]});
+				if (insts[k].op == Op::lis) block.back().push_back(insts[++k]);
+				continue;
+			}
+			schedule_block(model, block, scheduled, saved);
+			block.clear();
+			if (k < insts.size()) scheduled.push_back(insts[k]);
+		}
+		insts.swap(scheduled);
+	}
+
+	/** address frame slots from sp, once the frame size is known - loads and stores based on FRAME, **/
+	/** and words holding offsets from it, have the offset of the first slot from sp added **/
+	void rebase(int64_t offset) {
+		for (Instruction &inst : insts) {
+			if (inst.s != FRAME) continue;
+			inst.s = (inst.op == Op::dotword) ? 0 : 30;
+			inst.imm += offset;
+		}
+	}
+
+	/** append hand-written assembly, read line by line as the assembler would **/
+	void source(const std::string &text) {
+		std::istringstream in(text);
+		std::string line;
+		while (std::getline(in, line)) {
+			for (const Instruction &inst : Assembler::read(scan(line))) insts.push_back(inst);
+		}
+	}
+
+	/** machine code of the whole program, as a MERL object module (imports are left to the linker) **/
+	std::vector<int64_t> assemble() const { return Assembler().assemble(insts); }
+
+	friend std::ostream &operator<<(std::ostream &out, const Code &code) {
+		for (const Instruction &inst : code.insts) out << inst;
+		return out;
+	}
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "scanner.h"
+#include "assembler.h"
+#include "wlp4cycles.h"
+
+/*
+ * Cycle estimate of MIPS assembly, under the pipeline cost model wlp4gen schedules for - each
+ * instruction is issued once, in order (the estimate of a run with no branch taken)
+ *
+ *     ./wlp4cycles [MODEL] < prog.asm
+ *
+ * MODEL overrides the default latencies (see WLP4_CYCLE_MODEL for its form)
+ */
+int main(int argc, char *argv[]) {
+	CycleModel model;
+	if (argc > 1) {
+		std::ifstream file(argv[1]);
+		if (!file || !model.read(file)) {
+			std::cerr << "ERROR: Cannot read cycle model " << argv[1] << std::endl;
+			return 1;
+		}
+	}
+
+	CycleModel::Pipeline pipe(model);
+	std::string line;
+	try {
+		while (std::getline(std::cin, line)) {
+			// .import lines issue nothing (and are not taken by the scanner)
+			std::string first;
+			if (std::istringstream(line) >> first && first == ".import") continue;
+			for (const Assembler::Instruction &inst : Assembler::read(scan(line))) pipe.issue(inst);
+		}
+	} catch (ScanningFailure &f) {
+		std::cerr << f.what() << std::endl;
+		return 1;
+	} catch (AssemblerException &e) {
+		std::cerr << e.what() << std::endl;
+		return 2;
+	}
+
+	std::cout << "instructions:     " << pipe.insts << std::endl;
+	std::cout << "cycles:           " << pipe.cycles << std::endl;
+	std::cout << "stalls on loads:  " << pipe.loadStalls << std::endl;
+	std::cout << "stalls on HI/LO:  " << pipe.unitStalls << std::endl;
+	std::cout << "other stalls:     " << pipe.otherStalls << std::endl;
+	return 0;
+}
@@ -0,0 +1,149 @@
+#ifndef WLP4CYCLES_H
+#define WLP4CYCLES_H
+#include <algorithm>
+#include <istream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "assembler.h"
+
+// Default cycle model - one line per opcode, its name and latency: the cycles from the issue of an
+// instruction until one using its result can issue (opcodes left out take 1, so results of most are
+// ready for the very next instruction); a model file of the same form overrides any of them, and
+// ';' starts a comment
+const std::string WLP4_CYCLE_MODEL = R"END(
+lw 2		; load delay - one cycle before the loaded word can be used
+mult 4		; multiply unit - HI and LO ready to mfhi and mflo
+multu 4
+div 12
+divu 12
+)END";
+
+/** Pipeline cost model of an in-order MIPS, issuing at most one instruction per cycle - an **/
+/** instruction waits until the registers it reads are ready (latency cycles after the issue of the **/
+/** instruction writing them), mfhi and mflo wait for HI and LO, and as the multiply unit takes one **/
+/** operation at a time, mult and div wait for the previous result too **/
+class CycleModel {
+	std::map<Assembler::Op,int> latency;
+
+  public:
+	static constexpr int HI = 33, LO = 34;	// pseudo registers of the multiply unit results
+	static constexpr int REGS = 35;
+
+	CycleModel() {
+		std::istringstream in(WLP4_CYCLE_MODEL);
+		read(in);
+	}
+
+	/** read latencies of the form of WLP4_CYCLE_MODEL - return whether every line was understood **/
+	bool read(std::istream &in) {
+		std::string line;
+		while (std::getline(in, line)) {
+			std::istringstream iss(line.substr(0, line.find(';')));
+			std::string name;
+			int cycles;
+			if (!(iss >> name)) continue;
+			Assembler::Op op = Assembler::getOpType(name);
+			if (op == Assembler::Op::invalid || op == Assembler::Op::dotword || !(iss >> cycles) || cycles < 1)
+				return false;
+			latency[op] = cycles;
+		}
+		return true;
+	}
+
+	int of(Assembler::Op op) const {
+		auto it = latency.find(op);
+		return (it == latency.end()) ? 1 : it->second;
+	}
+
+	/** whether an instruction issues at all (labels, comments, imports and words do not) **/
+	static bool issues(const Assembler::Instruction &inst) {
+		return inst.op != Assembler::Op::labeldef && inst.op != Assembler::Op::note
+			&& inst.op != Assembler::Op::dotimport && inst.op != Assembler::Op::dotword;
+	}
+
+	/** the registers an instruction reads and writes, HI and LO included ($0 is never written) **/
+	static void operands(const Assembler::Instruction &inst, std::vector<int> &reads, std::vector<int> &writes) {
+		using Op = Assembler::Op;
+		reads.clear();
+		writes.clear();
+		switch (inst.op) {
+			case Op::add: case Op::sub: case Op::slt: case Op::sltu:
+				reads = {inst.s, inst.t};
+				writes = {inst.d};
+				break;
+			case Op::mult: case Op::multu: case Op::div: case Op::divu:
+				reads = {inst.s, inst.t};
+				writes = {HI, LO};
+				break;
+			case Op::mfhi:	reads = {HI}; writes = {inst.d}; break;
+			case Op::mflo:	reads = {LO}; writes = {inst.d}; break;
+			case Op::lis:	writes = {inst.d}; break;
+			case Op::lw:	reads = {inst.s}; writes = {inst.t}; break;
+			case Op::sw:	reads = {inst.s, inst.t}; break;
+			case Op::beq: case Op::bne:	reads = {inst.s, inst.t}; break;
+			case Op::jr:	reads = {inst.s}; break;
+			case Op::jalr:	reads = {inst.s}; writes = {31}; break;
+			default: break;
+		}
+		writes.erase(std::remove(writes.begin(), writes.end(), 0), writes.end());
+	}
+
+	/** Issue of a sequence of instructions under the model, each once and in order **/
+	class Pipeline {
+		const CycleModel &model;
+		std::vector<long long> ready;			// cycle each register is ready
+		std::vector<Assembler::Op> writer;		// opcode that last wrote each register
+		std::vector<int> reads, writes;
+
+	  public:
+		long long insts = 0, cycles = 0;
+		long long loadStalls = 0;				// cycles waiting for a loaded word
+		long long unitStalls = 0;				// cycles waiting for HI and LO
+		long long otherStalls = 0;
+
+		Pipeline(const CycleModel &model)
+			: model(model), ready(REGS, 0), writer(REGS, Assembler::Op::invalid), reads(), writes() {}
+
+		long long stalls() const { return loadStalls + unitStalls + otherStalls; }
+
+		/** issue the next instruction - return the cycles it stalled **/
+		long long issue(const Assembler::Instruction &inst) {
+			if (!issues(inst)) return 0;
+			operands(inst, reads, writes);
+			bool unit = std::find(writes.begin(), writes.end(), HI) != writes.end();
+			if (unit) reads.push_back(HI);
+
+			long long at = cycles;
+			int waited = -1;
+			for (int r : reads) {
+				if (ready[r] > at) {
+					at = ready[r];
+					waited = r;
+				}
+			}
+			if (waited == HI || waited == LO) unitStalls += at - cycles;
+			else if (waited >= 0 && writer[waited] == Assembler::Op::lw) loadStalls += at - cycles;
+			else if (waited >= 0) otherStalls += at - cycles;
+
+			for (int w : writes) {
+				ready[w] = at + model.of(inst.op);
+				writer[w] = inst.op;
+			}
+			long long stalled = at - cycles;
+			cycles = at + 1;
+			++insts;
+			return stalled;
+		}
+	};
+
+	/** cycles to issue a sequence of instructions, each once and in order **/
+	long long estimate(const std::vector<Assembler::Instruction> &insts) const {
+		Pipeline pipe(*this);
+		for (const Assembler::Instruction &inst : insts) pipe.issue(inst);
+		return pipe.cycles;
+	}
+};
+
+#endif
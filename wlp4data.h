@@ -16,6 +16,25 @@ const std::string TYPE_INT = "int";
 const std::string TYPE_INT_PTR = "int*";
 const int MIN_REG = 12;						// minimum free register is $12 ($11 is 1 const)
 const int MAX_REG = 28;						// maximum free register is $28 ($29 is fp)
+const int OMIT_FP_MAX_REG = 29;				// maximum free register with the frame pointer omitted
+const int MIN_VAR_REG = 6;				// first register for variables of leaf procedures
+const int MAX_VAR_REG = 10;				// last register for variables of leaf procedures ($11 is 1 const)
+const int REG_ARGS = 5;					// args passed in registers with --reg-args (leaf variable registers, $6 up)
+const int CONST_MAX_REGS = 4;				// most constants pinned to registers in a procedure
+const int LOOP_WEIGHT = 8;					// estimated iterations of a loop, weighting the uses within it
+const int INLINE_MAX_NODES = 64;			// largest procedure body (in parse tree nodes) to inline
+const int INLINE_MAX_DEPTH = 3;				// deepest nesting of inlined calls within inlined bodies
+const int INLINE_HOT_NODES = 256;			// largest procedure body to inline when the profile finds it hot
+const int INLINE_SIZE_NODES = 16;			// largest procedure body to inline with -Os (about the size of the call)
+const int CLONE_MAX_PROCS = 8;				// most procedure clones with constant params folded
+const int CLONE_MAX_GROWTH = 25;			// most nodes copied into clones, in percent of the program
+const int CLONE_MIN_NODES = 256;			// nodes clones may copy whatever the size of the program
+const long long PROFILE_HOT_RUNS = 64;		// fewest profiled runs making a procedure hot
+const int PROFILE_MAX_WEIGHT = 1 << 16;		// most profiled runs (per run of the procedure) weighting a use
+const int PROCS_PER_WORKER = 16;				// fewest procedures worth a generator thread of their own
+const int STUB_CALL_WORDS = 7;				// words of a call through a shared stub (-Os) - lis, word, lis, word, jalr, and
+											// the relocation entry of the stub address in the MERL module
+const int RETURN_STUB_WORDS = 3;			// words of the shared return tail (-Os)
 
 const std::string WLP4_CFG = R"END(.CFG
 start BOF procedures EOF
@@ -4,7 +4,15 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <atomic>
+#include <thread>
 #include "wlp4data.h"
+#include "wlp4sink.h"
+#include "wlp4code.h"
+#include "wlp4runtime.h"
 
 
 
@@ -97,6 +105,23 @@ class CFG {
 
 class WLP4ParseTree {
 	// Represents a WLP4ParseTree with the option to annotate if needed
+  public:
+	/** Options for the generated code **/
+	struct Options {
+		bool machineCode = false;	// output machine code, rather than assembly
+		int jobs = 1;				// most procedures generated at once
+		bool runtime = false;		// bundle the shipped runtime routines, rather than importing them
+		bool arena = false;			// allocate by bumping the heap top inline, never freeing (needs runtime)
+		bool inlinePrint = false;	// print inline within loops, rather than calling print (needs runtime)
+		bool instrument = false;	// count the runs of each procedure, IF arm and loop body, written out on exit
+		bool regArgs = false;		// pass the first REG_ARGS args in registers, rather than on the stack
+		bool omitFp = false;		// address frame slots from sp, freeing $29 as a stack register
+		CycleModel cycles;			// latencies the instructions of each basic block are scheduled around
+		bool size = false;			// share call sequences and procedure epilogues in stubs, for smaller code
+		bool staticFrames = false;	// give procedures never active twice a frame at a fixed address (needs fp)
+	};
+
+  private:
 
 	/** Internal parse tree structure **/
 	struct Node {
@@ -111,19 +136,116 @@ class WLP4ParseTree {
 	/** Internal data for individual variables in procedures **/
 	struct VarData {
 		int loc;
+		int reg = 0;		// register holding the variable instead of its frame slot (leaf procedures only)
 		std::string &type;
 		std::string TEMP = "";
 		VarData() : loc(0), type(TEMP) {};
 		VarData(int loc, std::string &type) : loc(loc), type(type) {}
 	};
 
+	/** Internal counters for the optimizations applied **/
+	struct OptStats {
+		int deadProcs = 0;			// unreachable procedures dropped
+		int deadBranches = 0;		// arms of constant tests dropped
+		int deadStores = 0;			// stores to never-read variables dropped
+		int inlinedCalls = 0;		// call sites replaced by the callee body
+		int inlinedProcs = 0;		// procedures no longer emitted since every call was inlined
+		int tailCalls = 0;			// calls in tail position reusing the caller frame
+		int tailRecursions = 0;		// self-recursive tail calls turned into jumps
+		int hoistedExprs = 0;		// loop-invariant expressions computed once ahead of their loop
+		int reusedExprs = 0;		// expressions reloaded since already computed in their run of statements
+		int regVars = 0;			// variables of leaf procedures kept in registers
+		int framelessProcs = 0;		// leaf procedures with every variable in registers, so without a frame
+		int savesSkipped = 0;		// stack registers left unsaved around calls, since the callee never touches them
+		int pinnedConsts = 0;		// constants kept in a register for the whole procedure
+		int bumpedNews = 0;			// allocations bumping the arena inline, instead of calling the runtime
+		int inlinedPrints = 0;		// prints within loops copied inline, instead of calling the runtime
+		int swappedArms = 0;		// IF arms swapped so the arm expected to run more runs without a jump
+		int rotatedLoops = 0;		// loops tested at the bottom, so each iteration takes one branch
+		int threadedJumps = 0;		// jumps and branches to a jump sent straight to its target
+		int droppedInsts = 0;		// jumps to the next instruction, and unreachable code, dropped
+		int spFrames = 0;			// frames addressed from sp, without a frame pointer
+		int reorderedOps = 0;		// binary operations computing their right operand first
+		int spillsAvoided = 0;		// pushes saved by that, against always computing the left operand first
+		int savedCycles = 0;		// cycles the scheduling of basic blocks is estimated to save (each run once)
+		int staticFrames = 0;		// frames at a fixed address, for procedures never active twice
+		int propagatedParams = 0;	// params folded into their procedure, as every call passes the same constant
+		int clonedProcs = 0;		// copies of procedures with params folded, for the hot calls passing those constants
+		int outlinedWords = 0;		// words saved by calls and epilogues going through shared stubs, net of the stubs
+		std::map<int,int> callGains;	// words a stub would save the calls saving each number of stack registers
+		int returnGain = 0;			// words a shared return tail would save the procedure epilogues
+
+		OptStats &operator+=(const OptStats &o) {
+			deadProcs += o.deadProcs;
+			deadBranches += o.deadBranches;
+			deadStores += o.deadStores;
+			inlinedCalls += o.inlinedCalls;
+			inlinedProcs += o.inlinedProcs;
+			tailCalls += o.tailCalls;
+			tailRecursions += o.tailRecursions;
+			hoistedExprs += o.hoistedExprs;
+			reusedExprs += o.reusedExprs;
+			regVars += o.regVars;
+			framelessProcs += o.framelessProcs;
+			savesSkipped += o.savesSkipped;
+			pinnedConsts += o.pinnedConsts;
+			bumpedNews += o.bumpedNews;
+			inlinedPrints += o.inlinedPrints;
+			swappedArms += o.swappedArms;
+			rotatedLoops += o.rotatedLoops;
+			threadedJumps += o.threadedJumps;
+			droppedInsts += o.droppedInsts;
+			spFrames += o.spFrames;
+			reorderedOps += o.reorderedOps;
+			spillsAvoided += o.spillsAvoided;
+			savedCycles += o.savedCycles;
+			staticFrames += o.staticFrames;
+			propagatedParams += o.propagatedParams;
+			clonedProcs += o.clonedProcs;
+			outlinedWords += o.outlinedWords;
+			for (auto &kv : o.callGains) callGains[kv.first] += kv.second;
+			returnGain += o.returnGain;
+			return *this;
+		}
+	};
+
+	/** Internal summary of what a WHILE loop may modify **/
+	struct LoopData {
+		std::set<std::string> assigned;		// variables assigned in the loop
+		bool memory = false;				// stores through pointers, calls, allocation or deletion
+	};
+
+	/** Internal summary of a call site, for propagating constant args **/
+	struct CallSite {
+		Node *node;							// the call factor
+		std::string caller;					// procedure the call is in
+		long long weight;					// estimated runs (profiled, or weighted by the loops around it)
+	};
+
 	/** Internal data for individual procedures **/
 	struct ProcData {
 		std::string id;
+		Node *node;
 		std::map<std::string,VarData> symTable;		// number of declarations+params in proc is symTable.size()
-
-		ProcData() : id(""), symTable() {}
-		ProcData(std::string &id) : id(id), symTable() {}
+		std::vector<std::string> params;			// parameter ids, in order
+		std::set<std::string> calls;				// procedures called from live code in this procedure
+		int callSites;								// calls to this procedure from live code, in every procedure
+		std::set<std::string> reads;				// variables read (or address taken) in live code
+		std::set<std::string> addressed;			// variables with their address taken in live code
+		int size;									// number of parse tree nodes in the body and return expr
+		bool runtime;								// whether live code prints, allocates or deletes
+		bool leaf;									// makes no calls, nor prints, allocates or deletes
+		bool frameless;								// leaf procedure with every variable in a register
+		bool staticFrame;							// frame at a fixed address (the label "D<proc>"), as never active twice
+		int regs;									// stack registers a call may clobber, from MIN_REG up
+		int inlineRegs;								// stack registers an inlined copy may clobber
+		std::vector<std::string> points;			// profile points - "entry", then the arms and bodies of IF and WHILE
+
+		ProcData() : id(""), node(nullptr), symTable(), params(), calls(), callSites(0), reads(), addressed(), size(0),
+			runtime(false), leaf(false), frameless(false), staticFrame(false), regs(0), inlineRegs(0), points() {}
+		ProcData(std::string &id, Node *node)
+			: id(id), node(node), symTable(), params(), calls(), callSites(0), reads(), addressed(), size(0),
+			  runtime(false), leaf(false), frameless(false), staticFrame(false), regs(0), inlineRegs(0), points() {}
 		VarData &operator[](std::string &varID) { return symTable[varID]; }
 	};
 
@@ -185,16 +307,28 @@ class WLP4ParseTree {
 		} else {
 			std::string procID;
 			std::istringstream(node->children[1]->seq) >> procID >> procID;
-			ProcData &table = ptable[procID] = ProcData(procID);
+			ProcData &table = ptable[procID] = ProcData(procID, node);
+			procs.push_back(node);
+			int ifK = 0, whileK = 0;
+			table.points.push_back("entry");
+			initpoints(node->children[(procID == "wain") ? 9 : 7], table, ifK, whileK);
 
 			if (procID == "wain") {
 				initsymtable(node->children[3], table);
 				initsymtable(node->children[5], table);
 				initsymtable_dcls(node->children[8], table);
+				initusage(node->children[9], table);
+				initusage(node->children[11], table);
+				table.size = count_nodes(node->children[9]) + count_nodes(node->children[11]);
 
 			} else {
 				initsymtable_params(node->children[3], table);
 				initsymtable_dcls(node->children[6], table);
+				initusage(node->children[7], table);
+				initusage(node->children[9], table);
+				table.size = count_nodes(node->children[7]) + count_nodes(node->children[9]);
+				inittail(node->children[7], node->children[9]);
+				initleaf(table);
 			}
 		}
 	}
@@ -211,6 +345,8 @@ class WLP4ParseTree {
 		// paramlist → dcl COMMA paramlist
 		} else {
 			initsymtable(node->children[0], table);
+			table.params.emplace_back();
+			std::istringstream(node->children[0]->children[1]->seq) >> table.params.back() >> table.params.back();
 			if (node->children.size() > 1)
 				initsymtable_params(node->children[2], table);
 		}
@@ -235,6 +371,1128 @@ class WLP4ParseTree {
 		table.symTable.emplace(id, VarData((-4 * i), node->children[1]->type));
 	}
 
+	/** collect calls and variable reads from live code, skipping arms of constant tests **/
+	void initusage(Node *node, ProcData &table) {
+		// statement → IF LPAREN test RPAREN LBRACE statements RBRACE ELSE LBRACE statements RBRACE
+		// statement → WHILE LPAREN test RPAREN LBRACE statements RBRACE
+		if (node->kind == "statement" && (node->children[0]->kind == "IF" || node->children[0]->kind == "WHILE")) {
+			int cond = fold_test(node->children[2]);
+			if (node->children[0]->kind == "WHILE" && cond == 0) return;
+			if (cond < 0) initusage(node->children[2], table);
+			if (cond != 0) initusage(node->children[5], table);
+			if (cond != 1 && node->children[0]->kind == "IF") initusage(node->children[9], table);
+			return;
+
+		// factor → ID LPAREN RPAREN
+		// factor → ID LPAREN arglist RPAREN
+		} else if (node->kind == "factor" && node->children[0]->kind == "ID" && node->children.size() > 1) {
+			std::string procID;
+			std::istringstream(node->children[0]->seq) >> procID >> procID;
+			table.calls.insert(procID);
+			++ptable[procID].callSites;
+			if (node->children.size() > 3) initusage(node->children[2], table);
+			return;
+
+		// factor → AMP lvalue
+		} else if (node->kind == "factor" && node->children[0]->kind == "AMP") {
+			Node *lvalueNode = node->children[1];
+			while (lvalueNode->children.size() > 2)
+				lvalueNode = lvalueNode->children[1];
+			if (lvalueNode->children.size() == 1) {
+				std::string id;
+				std::istringstream(lvalueNode->children[0]->seq) >> id >> id;
+				table.addressed.insert(id);
+			}
+
+		// factor → ID
+		// lvalue → ID (only when referenced by AMP, assignments to it are not reads)
+		} else if (node->kind == "ID") {
+			std::string id;
+			std::istringstream(node->seq) >> id >> id;
+			table.reads.insert(id);
+			return;
+
+		// statement → lvalue BECOMES expr SEMI
+		} else if (node->kind == "statement" && node->children[0]->kind == "lvalue") {
+			Node *lvalueNode = node->children[0];
+			while (lvalueNode->children.size() > 2)
+				lvalueNode = lvalueNode->children[1];
+			if (lvalueNode->children.size() == 2) initusage(lvalueNode, table);
+			initusage(node->children[2], table);
+			return;
+
+		// statement → PRINTLN LPAREN expr RPAREN SEMI
+		// statement → DELETE LBRACK RBRACK expr SEMI
+		// factor → NEW INT LBRACK expr RBRACK
+		} else if (node->kind == "PRINTLN" || node->kind == "DELETE" || node->kind == "NEW") {
+			table.runtime = true;
+			return;
+		}
+
+		for (Node *c : node->children) initusage(c, table);
+	}
+
+	/** name the profile points of the IF and WHILE statements of a procedure, numbered in source order **/
+	/** (constant tests too, so the names never depend on the optimizations applied) **/
+	void initpoints(Node *node, ProcData &table, int &ifK, int &whileK) {
+		// statement → IF LPAREN test RPAREN LBRACE statements RBRACE ELSE LBRACE statements RBRACE
+		if (node->kind == "statement" && node->children[0]->kind == "IF") {
+			points[node] = "if" + std::to_string(ifK++);
+			table.points.push_back(points[node] + "_then");
+			table.points.push_back(points[node] + "_else");
+
+		// statement → WHILE LPAREN test RPAREN LBRACE statements RBRACE
+		} else if (node->kind == "statement" && node->children[0]->kind == "WHILE") {
+			points[node] = "while" + std::to_string(whileK++);
+			table.points.push_back(points[node]);
+		}
+		for (Node *c : node->children) initpoints(c, table, ifK, whileK);
+	}
+
+	/** mark every procedure reachable from wain through the call graph **/
+	void initreachable(const std::string &procID) {
+		if (reachable.count(procID) != 0) return;
+		reachable.insert(procID);
+		for (const std::string &callee : ptable[procID].calls)
+			initreachable(callee);
+	}
+
+	/** keep the variables of leaf procedures (no calls, nor print and allocation) in registers **/
+	/** a leaf with all of its variables in registers needs no frame at all **/
+	/** (in declaration order - or with a profile, the most used first) **/
+	void initleaf(ProcData &table) {
+		if (!table.calls.empty() || table.runtime) return;
+		table.leaf = true;
+
+		std::map<std::string,int> uses;
+		if (!profile.empty()) {
+			count_uses(table.node->children[7], table.id, uses, 1);
+			count_uses(table.node->children[9], table.id, uses, 1);
+		}
+		std::vector<std::pair<std::pair<int,int>,std::string>> vars;
+		for (auto &kv : table.symTable) {
+			if (table.reads.count(kv.first) != 0 && table.addressed.count(kv.first) == 0)
+				vars.push_back({{-uses[kv.first], -kv.second.loc}, kv.first});
+		}
+		std::sort(vars.begin(), vars.end());
+
+		/* params passed in registers stay in them */
+		std::set<int> taken;
+		for (int i = 0; options.regArgs && i < std::min(REG_ARGS, (int) table.params.size()); ++i) {
+			std::string &param = table.params[i];
+			if (table.reads.count(param) != 0 && table.addressed.count(param) == 0)
+				taken.insert(table[param].reg = MIN_VAR_REG + i);
+		}
+
+		int reg = MIN_VAR_REG, regC = (int) taken.size();
+		for (auto &var : vars) {
+			if (table[var.second].reg != 0) continue;
+			while (taken.count(reg) != 0) ++reg;
+			if (reg > MAX_VAR_REG) break;
+			table[var.second].reg = reg++;
+			++regC;
+		}
+		table.frameless = table.addressed.empty() && regC == (int) vars.size();
+	}
+
+	/** count the uses of each variable, weighted as those of constants (see count_consts) **/
+	void count_uses(Node *node, const std::string &procID, std::map<std::string,int> &uses, int weight) {
+		// statement → IF LPAREN test RPAREN LBRACE statements RBRACE ELSE LBRACE statements RBRACE
+		// statement → WHILE LPAREN test RPAREN LBRACE statements RBRACE
+		if (node->kind == "statement" && (node->children[0]->kind == "IF" || node->children[0]->kind == "WHILE")) {
+			bool isWhile = (node->children[0]->kind == "WHILE");
+			count_uses(node->children[2], procID, uses, (isWhile) ? arm_weight(node, procID, "", weight) : weight);
+			count_uses(node->children[5], procID, uses, arm_weight(node, procID, (isWhile) ? "" : "_then", weight));
+			if (!isWhile) count_uses(node->children[9], procID, uses, arm_weight(node, procID, "_else", weight));
+			return;
+
+		// factor → ID
+		// lvalue → ID
+		} else if (node->kind == "ID") {
+			std::string id;
+			std::istringstream(node->seq) >> id >> id;
+			uses[id] += weight;
+			return;
+		}
+		for (Node *c : node->children) count_uses(c, procID, uses, weight);
+	}
+
+	/** bound the stack registers each procedure may clobber, in program order so callees come first **/
+	void initregs() {
+		const int limit = top_reg() - MIN_REG + 1;
+		for (Node *node : procs) {
+			// procedure → INT ID LPAREN params RPAREN LBRACE dcls statements RETURN expr SEMI RBRACE
+			if (node->kind == "main") continue;
+			std::string procID;
+			std::istringstream(node->children[1]->seq) >> procID >> procID;
+			ProcData &table = ptable[procID];
+			table.regs = std::min(limit, std::max(count_regs(node->children[7], table),
+												  count_regs(node->children[9], table)));
+			table.inlineRegs = std::min(limit, std::max(count_regs(node->children[7], table, true),
+														count_regs(node->children[9], table, true)));
+		}
+	}
+
+	/** bound the stack registers evaluating a subtree uses, including in the procedures it calls (which **/
+	/** are earlier in the program, so already counted) or inlines - only these need saving around calls **/
+	/** (inlined copies keep no variables in registers, so may need more) **/
+	int count_regs(Node *node, ProcData &table, bool inlined = false) {
+		// expr → expr PLUS term
+		// expr → expr MINUS term
+		// term → term STAR factor (and SLASH, PCT)
+		// test → expr EQ expr (and NE, LT, LE, GE, GT)
+		if (is_binary(node)) {
+			int left = count_regs(node->children[0], table, inlined), right = count_regs(node->children[2], table, inlined);
+			return operand_regs(node, table, inlined, right_first(node, table, inlined, left, right), left, right);
+
+		// statement → lvalue BECOMES expr SEMI (with lvalue → STAR factor, the value is held)
+		} else if (node->kind == "statement" && node->children[0]->kind == "lvalue") {
+			Node *lvalueNode = node->children[0];
+			while (lvalueNode->children.size() > 2)
+				lvalueNode = lvalueNode->children[1];
+			int regs = count_regs(node->children[2], table, inlined);
+			if (lvalueNode->children.size() == 1) return regs;
+			return std::max(regs, 1 + count_regs(lvalueNode->children[1], table, inlined));
+
+		// factor → ID LPAREN RPAREN
+		// factor → ID LPAREN arglist RPAREN
+		} else if (node->kind == "factor" && node->children[0]->kind == "ID" && node->children.size() > 1) {
+			std::string procID;
+			std::istringstream(node->children[0]->seq) >> procID >> procID;
+			int regs = (procID == table.id) ? 0
+					 : (recursive.count(procID) != 0) ? ptable[procID].regs : ptable[procID].inlineRegs;
+
+			/* args of a tail call are each held in a stack register until all are computed - as are */
+			/* other args, while later args may call */
+			bool tail = (tailCalls.count(node) != 0);
+			std::vector<Node*> args = arg_list(node);
+			std::vector<bool> held = held_args(args);
+			for (int i = 0, heldC = 0; i < (int) args.size(); ++i) {
+				regs = std::max(regs, ((tail) ? i : heldC) + count_regs(args[i], table, inlined));
+				if (tail) regs = std::max(regs, i + 1);
+				if (!tail && held[i]) regs = std::max(regs, ++heldC);
+			}
+			return regs;
+		}
+
+		int regs = 0;
+		for (Node *c : node->children) regs = std::max(regs, count_regs(c, table, inlined));
+		return regs;
+	}
+
+	/** the args of a call, in order **/
+	std::vector<Node*> arg_list(Node *node) {
+		// factor → ID LPAREN RPAREN
+		// factor → ID LPAREN arglist RPAREN
+		std::vector<Node*> args;
+		for (Node *argNode = node->children[2]; argNode->kind == "arglist"; argNode = argNode->children.back()) {
+			args.push_back(argNode->children[0]);
+			if (argNode->children.size() == 1) break;
+		}
+		return args;
+	}
+
+	/** which args are held elsewhere until every arg is computed - those followed by an arg that may **/
+	/** call (so overwrite the arg registers and the slots below sp) **/
+	std::vector<bool> held_args(std::vector<Node*> &args) {
+		std::vector<bool> held(args.size(), false);
+		bool effects = false;
+		for (int i = ((int) args.size()) - 1; i >= 0; --i) {
+			held[i] = effects;
+			effects = effects || has_effects(args[i]);
+		}
+		return held;
+	}
+
+	/** whether an operand of a binary operation (the left at side 0, the right at side 2) is left in a **/
+	/** stable register (see is_stable) **/
+	bool stable_operand(Node *node, ProcData &table, bool inlined, int side = 0) {
+		// sub case: typeof(expr, op, term) = (int, +, int*) scales the left operand
+		// sub case: typeof(expr, op, term) = (int*, ±, int) scales the right operand
+		if (node->kind == "expr" && node->children[side]->type == TYPE_INT && node->children[2 - side]->type == TYPE_INT_PTR)
+			return false;
+
+		Node *factorNode = unwrap_factor(node->children[side]);
+		if (factorNode == nullptr || factorNode->children.size() != 1) return false;
+
+		// factor → NUM
+		// factor → NULL
+		// factor → ID
+		Node *token = factorNode->children[0];
+		std::string str;
+		std::istringstream(token->seq) >> str >> str;
+		if (token->kind == "NULL") return true;
+		if (token->kind == "ID") return !inlined && table[str].reg != 0;
+		return str == "0" || str == "1" || str == "4";
+	}
+
+	// expr → expr PLUS term
+	// expr → expr MINUS term
+	// term → term STAR factor (and SLASH, PCT)
+	// test → expr EQ expr (and NE, LT, LE, GE, GT)
+	bool is_binary(Node *node) {
+		return ((node->kind == "expr" || node->kind == "term") && node->children.size() == 3) || node->kind == "test";
+	}
+
+	/** stack registers a binary operation needs, given those of its left and right operands - the operand **/
+	/** computed first is held (unless stable) while the other is computed **/
+	int operand_regs(Node *node, ProcData &table, bool inlined, bool rightFirst, int left, int right) {
+		if (rightFirst) return std::max(right, ((stable_operand(node, table, inlined, 2)) ? 0 : 1) + left);
+		return std::max(left, ((stable_operand(node, table, inlined)) ? 0 : 1) + right);
+	}
+
+	/** optimizing: Sethi–Ullman ordering - compute the right operand of a binary operation first when it **/
+	/** needs more stack registers than the left (or as many, but the left would be held and the right **/
+	/** need not be); never with effects on either side, so the order cannot be observed **/
+	bool right_first(Node *node, ProcData &table, bool inlined, int left, int right) {
+		if (has_effects(node->children[0]) || has_effects(node->children[2])) return false;
+		int leftFirst = operand_regs(node, table, inlined, false, left, right);
+		int rightFirst = operand_regs(node, table, inlined, true, left, right);
+		return rightFirst < leftFirst || (rightFirst == leftFirst
+				&& stable_operand(node, table, inlined, 2) && !stable_operand(node, table, inlined));
+	}
+
+	bool right_first(Node *node, ProcData &table) {
+		if (!is_binary(node)) return false;
+		bool inlined = (inlineDepth > 0);
+		return right_first(node, table, inlined, count_regs(node->children[0], table, inlined),
+						   count_regs(node->children[2], table, inlined));
+	}
+
+	/** mark every procedure that can reach itself through the call graph **/
+	void initrecursive() {
+		for (auto &kv : ptable) {
+			std::set<std::string> seen;
+			std::vector<std::string> work(kv.second.calls.begin(), kv.second.calls.end());
+			while (!work.empty()) {
+				std::string procID = work.back();
+				work.pop_back();
+				if (procID == kv.first) {
+					recursive.insert(procID);
+					break;
+				}
+				if (!seen.insert(procID).second) continue;
+				work.insert(work.end(), ptable[procID].calls.begin(), ptable[procID].calls.end());
+			}
+		}
+	}
+
+	/** with --static-frames, give each procedure that is never active twice - on no cycle of the call **/
+	/** graph (see initrecursive) - a frame at a fixed address, except wain and leaves without a frame; **/
+	/** calls from and to them are never tail calls, as those reuse a frame on the stack **/
+	void initstatic() {
+		if (!options.staticFrames || options.omitFp) return;
+		for (Node *node : procs) {
+			std::string procID;
+			std::istringstream(node->children[1]->seq) >> procID >> procID;
+			ProcData &table = ptable[procID];
+			table.staticFrame = procID != "wain" && recursive.count(procID) == 0 && !table.frameless;
+			if (table.staticFrame) untail(node);
+		}
+		for (auto it = tailCalls.begin(); it != tailCalls.end(); ) {
+			std::string procID;
+			std::istringstream((*it)->children[0]->seq) >> procID >> procID;
+			if (ptable[procID].staticFrame) it = tailCalls.erase(it);
+			else ++it;
+		}
+	}
+
+	/** interprocedural constant propagation, over the procedures before wain from the last to the **/
+	/** first - since procedures only call earlier ones (or themselves), every call to a procedure is **/
+	/** final by the time it is reached; an int param never assigned nor addressed is folded when **/
+	/** every call passes it the same constant, and dropped from the calls; otherwise the hottest **/
+	/** groups of calls passing the same constants get a clone of the procedure with those params **/
+	/** folded ("<proc>__c<val>", its label "F<proc>__c<val>" - IDs have no '_', so it never clashes), **/
+	/** within a budget of clones and of nodes copied - return whether the tree changed **/
+	bool initclones() {
+		int nodes = 0;
+		for (const std::string &procID : reachable) nodes += ptable[procID].size;
+		int budget = (options.size) ? 0 : std::max(CLONE_MIN_NODES, nodes * CLONE_MAX_GROWTH / 100);
+		int cloneC = 0;
+		bool changed = false;
+
+		std::vector<Node*> order = procs;
+		for (int k = ((int) order.size()) - 1; k >= 0; --k) {
+			// procedure → INT ID LPAREN params RPAREN LBRACE dcls statements RETURN expr SEMI RBRACE
+			Node *procNode = order[k];
+			if (procNode->kind == "main") continue;
+			std::string procID;
+			std::istringstream(procNode->children[1]->seq) >> procID >> procID;
+			ProcData &table = ptable[procID];
+			if (reachable.count(procID) == 0) continue;
+
+			std::vector<bool> foldable;
+			for (std::string &param : table.params)
+				foldable.push_back(table[param].type == TYPE_INT && !writes_var(procNode->children[7], param)
+								   && !writes_var(procNode->children[9], param));
+			std::vector<CallSite> sites;
+			for (Node *node = root->children[1]; ; node = node->children[1]) {
+				// procedures → procedure procedures
+				// procedures → main
+				Node *caller = node->children[0];
+				std::string callerID;
+				std::istringstream(caller->children[1]->seq) >> callerID >> callerID;
+				long long entries = profile_runs(callerID, "entry");
+				int body = (caller->kind == "main") ? 9 : 7;
+				std::vector<CallSite> found;
+				find_calls(caller->children[body], procID, callerID, 1, found);
+				find_calls(caller->children[body + 2], procID, callerID, 1, found);
+				for (CallSite &site : found) {
+					if (entries >= 0) site.weight *= entries;
+					sites.push_back(site);
+				}
+				if (node->children.size() == 1) break;
+			}
+
+			/* optimizing: fold a param every call passes the same constant (or a recursive call the */
+			/* param itself), and drop it from every call */
+			std::set<int> folded;
+			std::vector<std::string> params;
+			std::vector<bool> keptFoldable;
+			for (int i = 0; i < (int) table.params.size(); ++i) {
+				int val = -1;
+				for (CallSite &site : sites) {
+					if (site.caller == procID) continue;
+					if (!const_arg(arg_list(site.node)[i], val)) val = -1;
+					break;
+				}
+				bool same = foldable[i] && val >= 0;
+				for (CallSite &site : sites) {
+					int v;
+					if (site.caller == procID) same = same && binds(site.node, {{i, val}}, table.params);
+					else same = same && const_arg(arg_list(site.node)[i], v) && v == val;
+				}
+				if (!same) {
+					params.push_back(table.params[i]);
+					keptFoldable.push_back(foldable[i]);
+					continue;
+				}
+				fold_param(procNode, table.params[i], val);
+				folded.insert(i);
+				++stats.propagatedParams;
+			}
+			if (!folded.empty()) {
+				for (CallSite &site : sites) drop_args(site.node, folded);
+				drop_params(procNode, folded);
+				foldable = keptFoldable;
+				changed = true;
+			}
+
+			/* optimizing: clone it for the hottest groups of calls from other procedures passing the */
+			/* same constants to foldable params - of a recursive procedure, only to params its */
+			/* recursive calls pass on unchanged, so the clone calls itself */
+			for (CallSite &site : sites) {
+				if (site.caller != procID) continue;
+				for (int i = 0; i < (int) params.size(); ++i)
+					foldable[i] = foldable[i] && binds(site.node, {{i, -1}}, params);
+			}
+			std::map<std::vector<std::pair<int,int>>,std::vector<CallSite>> groups;
+			for (CallSite &site : sites) {
+				if (site.caller == procID || (reachable.count(site.caller) == 0 && site.caller.find("__") == std::string::npos))
+					continue;
+				std::vector<Node*> args = arg_list(site.node);
+				std::vector<std::pair<int,int>> binding;
+				for (int i = 0; i < (int) args.size(); ++i) {
+					int v;
+					if (foldable[i] && const_arg(args[i], v)) binding.emplace_back(i, v);
+				}
+				if (!binding.empty()) groups[binding].push_back(site);
+			}
+			/* (a group is hot when its calls run, profiled or estimated, at least LOOP_WEIGHT times, and of */
+			/* a recursive procedure at any call, as the clone runs for every level of the recursion) - */
+			/* and only kept if the constants decide a test, or the clone calls itself */
+			std::vector<std::pair<long long,std::vector<std::pair<int,int>>>> ranked;
+			for (auto &kv : groups) {
+				long long weight = 0;
+				for (CallSite &site : kv.second) weight += site.weight;
+				if (weight >= LOOP_WEIGHT || (weight > 0 && recursive.count(procID) != 0)) ranked.emplace_back(-weight, kv.first);
+			}
+			std::sort(ranked.begin(), ranked.end());
+			for (auto &r : ranked) {
+				if (cloneC >= CLONE_MAX_PROCS || table.size > budget) break;
+				std::string cloneID = procID + "__c";
+				for (auto &b : r.second) cloneID += ((&b == &r.second.front()) ? "" : "_") + std::to_string(b.second);
+				if (ptable.count(cloneID) != 0) cloneID += "_" + std::to_string(cloneC);
+				Node *clone = clone_proc(procNode, cloneID, params, r.second);
+				if (recursive.count(procID) == 0 && const_tests(clone->children[7]) == const_tests(procNode->children[7])) {
+					drop_points(clone);
+					delete clone;
+					continue;
+				}
+				insert_proc(procNode, clone);
+				for (CallSite &site : groups[r.second]) {
+					site.node->children[0]->seq = "ID " + cloneID;
+					std::set<int> bound;
+					for (auto &b : r.second) bound.insert(b.first);
+					drop_args(site.node, bound);
+				}
+				ptable[cloneID].id = cloneID;
+				budget -= table.size;
+				++cloneC;
+				++stats.clonedProcs;
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	/** whether a call passes the params of a binding (positions and constants) either those constants, **/
+	/** or the params themselves (from within the procedure, keeping them) **/
+	bool binds(Node *node, const std::vector<std::pair<int,int>> &binding, const std::vector<std::string> &params) {
+		std::vector<Node*> args = arg_list(node);
+		for (auto &b : binding) {
+			int v;
+			Node *argFactor = unwrap_factor(args[b.first]);
+			std::string id;
+			if (argFactor != nullptr && argFactor->children.size() == 1 && argFactor->children[0]->kind == "ID")
+				std::istringstream(argFactor->children[0]->seq) >> id >> id;
+			if (id != params[b.first] && !(const_arg(args[b.first], v) && v == b.second)) return false;
+		}
+		return true;
+	}
+
+	/** the value of a constant int arg that a NUM can hold - false if not one **/
+	bool const_arg(Node *arg, int &val) {
+		return arg->type == TYPE_INT && fold_expr(arg, val) && val >= 0;
+	}
+
+	/** collect the calls to a procedure within a subtree, weighted as uses (see count_uses) **/
+	void find_calls(Node *node, const std::string &calleeID, const std::string &callerID, long long weight,
+					std::vector<CallSite> &sites) {
+		// statement → IF LPAREN test RPAREN LBRACE statements RBRACE ELSE LBRACE statements RBRACE
+		// statement → WHILE LPAREN test RPAREN LBRACE statements RBRACE
+		if (node->kind == "statement" && (node->children[0]->kind == "IF" || node->children[0]->kind == "WHILE")) {
+			bool isWhile = (node->children[0]->kind == "WHILE");
+			find_calls(node->children[2], calleeID, callerID, (isWhile) ? arm_weight(node, callerID, "", weight) : weight, sites);
+			find_calls(node->children[5], calleeID, callerID, arm_weight(node, callerID, (isWhile) ? "" : "_then", weight), sites);
+			if (!isWhile) find_calls(node->children[9], calleeID, callerID, arm_weight(node, callerID, "_else", weight), sites);
+			return;
+
+		// factor → ID LPAREN RPAREN
+		// factor → ID LPAREN arglist RPAREN
+		} else if (node->kind == "factor" && node->children[0]->kind == "ID" && node->children.size() > 1) {
+			std::string procID;
+			std::istringstream(node->children[0]->seq) >> procID >> procID;
+			if (procID == calleeID) sites.push_back(CallSite{node, callerID, weight});
+		}
+		for (Node *c : node->children) find_calls(c, calleeID, callerID, weight, sites);
+	}
+
+	/** whether a subtree assigns a variable or takes its address (lvalue → ID) **/
+	bool writes_var(Node *node, const std::string &id) {
+		// lvalue → ID
+		if (node->kind == "lvalue" && node->children.size() == 1) {
+			std::string str;
+			std::istringstream(node->children[0]->seq) >> str >> str;
+			return str == id;
+		}
+		for (Node *c : node->children)
+			if (writes_var(c, id)) return true;
+		return false;
+	}
+
+	/** replace every read of a param in the body and return expr of a procedure by a constant **/
+	void fold_param(Node *node, const std::string &id, int val) {
+		// procedure → INT ID LPAREN params RPAREN LBRACE dcls statements RETURN expr SEMI RBRACE
+		if (node->kind == "procedure") {
+			fold_param(node->children[7], id, val);
+			fold_param(node->children[9], id, val);
+			return;
+
+		// factor → ID (becoming factor → NUM)
+		} else if (node->kind == "factor" && node->children.size() == 1 && node->children[0]->kind == "ID") {
+			std::string str;
+			std::istringstream(node->children[0]->seq) >> str >> str;
+			if (str != id) return;
+			delete node->children[0];
+			std::string kind = "NUM";
+			node->children[0] = new Node(kind, "NUM " + std::to_string(val));
+			node->children[0]->type = TYPE_INT;
+			node->seq = "factor NUM";
+			return;
+		}
+		for (Node *c : node->children) fold_param(c, id, val);
+	}
+
+	/** copy a procedure with the given params folded to constants and dropped - its calls to the **/
+	/** procedure passing those constants (or the params themselves) call the copy **/
+	Node *clone_proc(Node *procNode, const std::string &cloneID, const std::vector<std::string> &params,
+					const std::vector<std::pair<int,int>> &binding) {
+		std::string procID;
+		std::istringstream(procNode->children[1]->seq) >> procID >> procID;
+		Node *clone = copy_tree(procNode);
+		clone->children[1]->seq = "ID " + cloneID;
+
+		/* recursive calls binding the same params are found before the params are folded */
+		std::vector<CallSite> self;
+		find_calls(clone->children[7], procID, procID, 1, self);
+		find_calls(clone->children[9], procID, procID, 1, self);
+		std::set<int> bound;
+		for (auto &b : binding) bound.insert(b.first);
+		for (CallSite &site : self) {
+			if (!binds(site.node, binding, params)) continue;
+			site.node->children[0]->seq = "ID " + cloneID;
+			drop_args(site.node, bound);
+		}
+		for (auto &b : binding) fold_param(clone, params[b.first], b.second);
+		drop_params(clone, bound);
+		return clone;
+	}
+
+	/** insert a procedure into the program right after another **/
+	void insert_proc(Node *procNode, Node *newNode) {
+		// procedures → procedure procedures
+		for (Node *node = root->children[1]; node->children.size() > 1; node = node->children[1]) {
+			if (node->children[0] != procNode) continue;
+			std::string kind = "procedures";
+			Node *rest = new Node(kind, "procedures procedure procedures");
+			rest->children = {newNode, node->children[1]};
+			node->children[1] = rest;
+			return;
+		}
+	}
+
+	/** the IF and WHILE statements within a subtree with a constant test **/
+	int const_tests(Node *node) {
+		// statement → IF LPAREN test RPAREN LBRACE statements RBRACE ELSE LBRACE statements RBRACE
+		// statement → WHILE LPAREN test RPAREN LBRACE statements RBRACE
+		int n = 0;
+		if (node->kind == "statement" && (node->children[0]->kind == "IF" || node->children[0]->kind == "WHILE"))
+			n += (fold_test(node->children[2]) >= 0) ? 1 : 0;
+		for (Node *c : node->children) n += const_tests(c);
+		return n;
+	}
+
+	/** forget the profile points of the statements within a subtree, before freeing it **/
+	void drop_points(Node *node) {
+		points.erase(node);
+		for (Node *c : node->children) drop_points(c);
+	}
+
+	/** deep copy of a subtree, keeping the profile points of its statements **/
+	Node *copy_tree(Node *node) {
+		Node *copy = new Node(node->kind, node->seq);
+		copy->type = node->type;
+		for (Node *c : node->children) copy->children.push_back(copy_tree(c));
+		if (points.count(node) != 0) points[copy] = points[node];
+		return copy;
+	}
+
+	/** take the items of a list (arglist or paramlist), freeing the list nodes **/
+	std::vector<Node*> take_list(Node *node) {
+		// arglist → expr
+		// arglist → expr COMMA arglist
+		std::vector<Node*> items;
+		while (node != nullptr) {
+			items.push_back(node->children[0]);
+			node->children[0] = nullptr;
+			Node *next = nullptr;
+			if (node->children.size() > 1) std::swap(next, node->children[2]);
+			delete node;
+			node = next;
+		}
+		return items;
+	}
+
+	/** build a list (arglist or paramlist) of the given items, all of kind item **/
+	Node *make_list(std::string kind, const std::string &item, const std::vector<Node*> &items) {
+		Node *list = nullptr;
+		for (int i = ((int) items.size()) - 1; i >= 0; --i) {
+			Node *node = new Node(kind, kind + " " + item + ((list == nullptr) ? "" : " COMMA " + kind));
+			node->children.push_back(items[i]);
+			if (list != nullptr) {
+				std::string comma = "COMMA";
+				node->children.push_back(new Node(comma, "COMMA ,"));
+				node->children.push_back(list);
+			}
+			list = node;
+		}
+		return list;
+	}
+
+	/** drop the args at the given positions from a call **/
+	void drop_args(Node *node, const std::set<int> &drop) {
+		// factor → ID LPAREN arglist RPAREN
+		std::vector<Node*> kept;
+		std::vector<Node*> args = take_list(node->children[2]);
+		for (int i = 0; i < (int) args.size(); ++i) {
+			if (drop.count(i) != 0) delete args[i];
+			else kept.push_back(args[i]);
+		}
+
+		// factor → ID LPAREN RPAREN
+		if (kept.empty()) {
+			node->children.erase(node->children.begin() + 2);
+			node->seq = "factor ID LPAREN RPAREN";
+		} else {
+			node->children[2] = make_list("arglist", "expr", kept);
+		}
+	}
+
+	/** drop the params at the given positions from a procedure **/
+	void drop_params(Node *procNode, const std::set<int> &drop) {
+		// params → ε
+		// params → paramlist
+		Node *paramsNode = procNode->children[3];
+		std::vector<Node*> kept;
+		std::vector<Node*> params = take_list(paramsNode->children[0]);
+		for (int i = 0; i < (int) params.size(); ++i) {
+			if (drop.count(i) != 0) delete params[i];
+			else kept.push_back(params[i]);
+		}
+		paramsNode->children.clear();
+		paramsNode->seq = "params";
+		if (!kept.empty()) {
+			paramsNode->children.push_back(make_list("paramlist", "dcl", kept));
+			paramsNode->seq = "params paramlist";
+		}
+	}
+
+	/** mark calls in tail position - either the whole RETURN expr, or the last assignment **/
+	/** (through trailing IF arms) to the variable that the RETURN expr consists of **/
+	void inittail(Node *stmtsNode, Node *exprNode) {
+		Node *callNode = unwrap_factor(exprNode);
+		if (callNode == nullptr) return;
+
+		// factor → ID LPAREN RPAREN
+		// factor → ID LPAREN arglist RPAREN
+		if (callNode->children.size() > 1 && callNode->children[0]->kind == "ID") {
+			tailCalls.insert(callNode);
+
+		// factor → ID
+		} else if (callNode->children[0]->kind == "ID") {
+			std::string id;
+			std::istringstream(callNode->children[0]->seq) >> id >> id;
+			inittail_stmts(stmtsNode, id);
+		}
+	}
+
+	void inittail_stmts(Node *node, const std::string &tailVar) {
+		// statements → ε
+		// statements → statements statement
+		if (node->children.size() == 0) return;
+		Node *stmtNode = node->children[1];
+
+		// statement → IF LPAREN test RPAREN LBRACE statements RBRACE ELSE LBRACE statements RBRACE
+		if (stmtNode->children[0]->kind == "IF") {
+			inittail_stmts(stmtNode->children[5], tailVar);
+			inittail_stmts(stmtNode->children[9], tailVar);
+
+		// statement → lvalue BECOMES expr SEMI
+		} else if (stmtNode->children[0]->kind == "lvalue") {
+			Node *lvalueNode = stmtNode->children[0];
+			while (lvalueNode->children.size() > 2)
+				lvalueNode = lvalueNode->children[1];
+			if (lvalueNode->children.size() != 1) return;
+
+			std::string id;
+			std::istringstream(lvalueNode->children[0]->seq) >> id >> id;
+			Node *callNode = unwrap_factor(stmtNode->children[2]);
+			if (id == tailVar && callNode != nullptr && callNode->children.size() > 1 && callNode->children[0]->kind == "ID")
+				tailCalls.insert(callNode);
+		}
+	}
+
+	/** calls in tail position reuse the frame of their procedure, so none are left in a procedure whose **/
+	/** frame slots may have their address taken - its own variables, or those of a callee inlined into it **/
+	void initescapes() {
+		for (Node *node : procs) {
+			std::string procID;
+			std::istringstream(node->children[1]->seq) >> procID >> procID;
+			if (frame_addressed(ptable[procID], 0)) untail(node);
+		}
+	}
+
+	bool frame_addressed(ProcData &table, int depth) {
+		if (!table.addressed.empty()) return true;
+		for (const std::string &callee : table.calls)
+			if (callee != table.id && inlinable(callee, depth) && frame_addressed(ptable[callee], depth + 1)) return true;
+		return false;
+	}
+
+	/** unmark the calls in tail position within a subtree **/
+	void untail(Node *node) {
+		tailCalls.erase(node);
+		for (Node *c : node->children) untail(c);
+	}
+
+	/** strip an expr of single-child rules and parentheses - return nullptr if not a lone factor **/
+	Node *unwrap_factor(Node *node) {
+		while (true) {
+			if (node->kind == "factor" && node->children[0]->kind == "LPAREN") {
+				node = node->children[1];
+			} else if (node->kind == "factor") {
+				return node;
+			} else if (node->children.size() == 1) {
+				node = node->children[0];
+			} else {
+				return nullptr;
+			}
+		}
+	}
+
+	int count_nodes(Node *node) {
+		int n = 1;
+		for (Node *c : node->children) n += count_nodes(c);
+		return n;
+	}
+
+	/*********************************/
+	/** compile-time helper-methods **/
+	/*********************************/
+
+	/** runs of a profile point of a procedure in the profiled runs - -1 when the profile has none **/
+	/** (a clone, see initclones, has the runs of the procedure it copies unless profiled itself) **/
+	long long profile_runs(const std::string &procID, const std::string &point) {
+		auto it = profile.find(procID + " " + point);
+		size_t clone = procID.find("__");
+		if (it == profile.end() && clone != std::string::npos) return profile_runs(procID.substr(0, clone), point);
+		return (it == profile.end()) ? -1 : it->second;
+	}
+
+	/** weight of the uses in an arm of an IF ("_then" or "_else") or the body of a WHILE ("") - the **/
+	/** profiled runs per run of the procedure (rounded), or else the weight around it, times **/
+	/** LOOP_WEIGHT for loops **/
+	int arm_weight(Node *node, const std::string &procID, const std::string &arm, int weight) {
+		long long runs = profile_runs(procID, points[node] + arm);
+		long long entries = profile_runs(procID, "entry");
+		if (runs < 0 || entries < 0) return (arm.empty()) ? weight * LOOP_WEIGHT : weight;
+		if (entries == 0) return 0;
+		return (int) std::min<long long>(PROFILE_MAX_WEIGHT, (2 * runs + entries) / (2 * entries));
+	}
+
+	/** fold constant int expressions (and bare NULL) - return false when not constant **/
+	bool fold_expr(Node *node, int &val) {
+		// expr → term
+		// term → factor
+		// factor → LPAREN expr RPAREN
+		if (node->kind != "factor" && node->children.size() == 1)
+			return fold_expr(node->children[0], val);
+		if (node->kind == "factor" && node->children[0]->kind == "LPAREN")
+			return fold_expr(node->children[1], val);
+
+		// factor → NUM
+		// factor → NULL
+		if (node->kind == "factor") {
+			if (node->children.size() != 1 || node->children[0]->kind == "ID") return false;
+			std::string str;
+			std::istringstream(node->children[0]->seq) >> str >> str;
+			val = (node->children[0]->kind == "NULL") ? 1 : std::stoi(str);
+			return true;
+		}
+
+		// expr → expr PLUS term
+		// expr → expr MINUS term
+		// term → term STAR factor
+		// term → term SLASH factor
+		// term → term PCT factor
+		int x, y;
+		if (node->type != TYPE_INT || node->children[0]->type != TYPE_INT || node->children[2]->type != TYPE_INT) return false;
+		if (!fold_expr(node->children[0], x) || !fold_expr(node->children[2], y)) return false;
+
+		std::string &op = node->children[1]->kind;
+		if ((op == "SLASH" || op == "PCT") && y == 0) return false;
+		val = (op == "PLUS") ? (int) ((unsigned) x + (unsigned) y)
+			: (op == "MINUS") ? (int) ((unsigned) x - (unsigned) y)
+			: (op == "STAR") ? (int) ((unsigned) x * (unsigned) y)
+			: (op == "SLASH") ? ((y == -1) ? (int) (0u - (unsigned) x) : x / y)
+			: ((y == -1) ? 0 : x % y);
+		return true;
+	}
+
+	/** fold constant tests - return 1 (always true), 0 (always false) or -1 (unknown) **/
+	int fold_test(Node *node) {
+		int x, y;
+		if (!fold_expr(node->children[0], x) || !fold_expr(node->children[2], y)) return -1;
+
+		std::string &kind = node->children[1]->kind;
+		bool lt = (node->children[0]->type == TYPE_INT_PTR) ? ((unsigned) x < (unsigned) y) : (x < y);
+		bool gt = (node->children[0]->type == TYPE_INT_PTR) ? ((unsigned) x > (unsigned) y) : (x > y);
+		bool cond = (kind == "EQ") ? (x == y)
+				  : (kind == "NE") ? (x != y)
+				  : (kind == "LT") ? lt
+				  : (kind == "GT") ? gt
+				  : (kind == "LE") ? !gt : !lt;
+		return (cond) ? 1 : 0;
+	}
+
+	/** collect the variables and memory a loop may modify **/
+	void scan_loop(Node *node, LoopData &loop) {
+		// statement → lvalue BECOMES expr SEMI
+		if (node->kind == "statement" && node->children[0]->kind == "lvalue") {
+			Node *lvalueNode = node->children[0];
+			while (lvalueNode->children.size() > 2)
+				lvalueNode = lvalueNode->children[1];
+
+			if (lvalueNode->children.size() == 1) {
+				std::string id;
+				std::istringstream(lvalueNode->children[0]->seq) >> id >> id;
+				loop.assigned.insert(id);
+			} else {
+				loop.memory = true;
+			}
+
+		// statement → DELETE LBRACK RBRACK expr SEMI
+		// factor → NEW INT LBRACK expr RBRACK
+		// factor → ID LPAREN RPAREN
+		// factor → ID LPAREN arglist RPAREN
+		} else if (node->kind == "DELETE" || node->kind == "NEW" || (node->kind == "factor"
+				&& node->children.size() > 1 && node->children[0]->kind == "ID")) {
+			loop.memory = true;
+		}
+		for (Node *c : node->children) scan_loop(c, loop);
+	}
+
+	/** mark loop-invariant nodes - loads, and divisions by anything but a nonzero constant, are only **/
+	/** invariant in the test, which always runs (hoisting them from the body could fault where the **/
+	/** source never would) **/
+	bool find_invariant(Node *node, ProcData &table, LoopData &loop, bool inTest, std::map<Node*,bool> &inv) {
+		bool result = true;
+
+		if (reload.count(node) != 0) {
+			result = true;
+
+		// factor → ID
+		} else if (node->kind == "ID") {
+			std::string id;
+			std::istringstream(node->seq) >> id >> id;
+			result = loop.assigned.count(id) == 0 && (!loop.memory || table.addressed.count(id) == 0);
+
+		// factor → NEW INT LBRACK expr RBRACK
+		// factor → ID LPAREN RPAREN
+		// factor → ID LPAREN arglist RPAREN
+		} else if (node->kind == "factor" && node->children.size() > 1
+				&& (node->children[0]->kind == "ID" || node->children[0]->kind == "NEW")) {
+			result = false;
+			for (Node *c : node->children) find_invariant(c, table, loop, inTest, inv);
+
+		// factor → AMP lvalue (the address of a variable never changes)
+		} else if (node->kind == "factor" && node->children[0]->kind == "AMP") {
+			Node *lvalueNode = node->children[1];
+			while (lvalueNode->children.size() > 2)
+				lvalueNode = lvalueNode->children[1];
+			if (lvalueNode->children.size() == 2)
+				result = find_invariant(lvalueNode->children[1], table, loop, inTest, inv);
+
+		} else {
+			for (Node *c : node->children)
+				result = find_invariant(c, table, loop, inTest, inv) && result;
+
+			// factor → STAR factor
+			if (node->kind == "factor" && node->children[0]->kind == "STAR")
+				result = result && inTest && !loop.memory;
+
+			// term → term SLASH factor
+			// term → term PCT factor
+			int divisor;
+			if (node->kind == "term" && node->children.size() == 3 && node->children[1]->kind != "STAR"
+					&& !(fold_expr(node->children[2], divisor) && divisor != 0))
+				result = result && inTest;
+		}
+		return inv[node] = result;
+	}
+
+	/** collect the maximal invariant expressions that cost more than reloading them **/
+	void collect_invariant(Node *node, std::map<Node*,bool> &inv, std::vector<Node*> &found) {
+		if (reload.count(node) != 0) return;
+
+		bool isValue = (node->kind == "expr" || node->kind == "term" || node->kind == "factor");
+		if (isValue && inv[node]) {
+			Node *inner = node;
+			while (inner->kind == "factor" && inner->children[0]->kind == "LPAREN")
+				inner = inner->children[1];
+
+			if (is_costly(inner)) {
+				found.push_back(node);
+				return;
+			}
+		}
+
+		// factor → AMP lvalue (only the address under a dereference is ever evaluated)
+		if (node->kind == "factor" && node->children[0]->kind == "AMP") {
+			Node *lvalueNode = node->children[1];
+			while (lvalueNode->children.size() > 2)
+				lvalueNode = lvalueNode->children[1];
+			if (lvalueNode->children.size() == 2) collect_invariant(lvalueNode->children[1], inv, found);
+			return;
+		}
+		for (Node *c : node->children) collect_invariant(c, inv, found);
+	}
+
+	/** whether an expression costs more to compute than to reload it from a frame slot **/
+	bool is_costly(Node *node) {
+		// expr → expr PLUS term
+		// expr → expr MINUS term
+		// term → term STAR factor (and SLASH, PCT)
+		// factor → STAR factor
+		int val;
+		bool costly = (node->children.size() == 3 && node->kind != "factor")
+					|| (node->kind == "factor" && node->children[0]->kind == "STAR");
+		return costly && !fold_expr(node, val);
+	}
+
+	/** number the values of a run of statements - an expression already computed in the run is reloaded **/
+	/** from the slot its first computation is saved to - return the slot count (reserved past frameTop) **/
+	int number_values(std::vector<Node*> &run, ProcData &table, std::vector<Node*> &numbered) {
+		if (table.frameless) return 0;
+		std::map<std::string,Node*> avail;
+		std::vector<std::pair<Node*,Node*>> reuses;
+		int slotC = 0;
+
+		for (Node *stmtNode : run) number_stmt(stmtNode, table, avail, reuses);
+		for (auto &reuse : reuses) {
+			if (saves.count(reuse.second) == 0) {
+				saves[reuse.second] = -4 * (frameTop + slotC++);
+				numbered.push_back(reuse.second);
+			}
+			reload[reuse.first] = saves[reuse.second];
+			numbered.push_back(reuse.first);
+			++stats.reusedExprs;
+		}
+
+		frameTop += slotC;
+		frameSize = std::max(frameSize, frameTop);
+		return slotC;
+	}
+
+	/** number the values of a statement, in the order generate_stmt evaluates them **/
+	void number_stmt(Node *node, ProcData &table, std::map<std::string,Node*> &avail, std::vector<std::pair<Node*,Node*>> &reuses) {
+		// statement → PRINTLN LPAREN expr RPAREN SEMI
+		if (node->children[0]->kind == "PRINTLN") {
+			number_value(node->children[2], table, avail, reuses);
+
+		// statement → IF LPAREN test RPAREN LBRACE statements RBRACE ELSE LBRACE statements RBRACE
+		// (only the test belongs to the run)
+		} else if (node->children[0]->kind == "IF") {
+			if (fold_test(node->children[2]) >= 0) return;
+			int first = (right_first(node->children[2], table)) ? 2 : 0;
+			number_value(node->children[2]->children[first], table, avail, reuses);
+			number_value(node->children[2]->children[2 - first], table, avail, reuses);
+
+		// statement → DELETE LBRACK RBRACK expr SEMI
+		} else if (node->children[0]->kind == "DELETE") {
+			number_value(node->children[3], table, avail, reuses);
+			kill_values(avail, table, "");
+
+		// statement → lvalue BECOMES expr SEMI
+		} else if (node->children[0]->kind == "lvalue") {
+			Node *lvalueNode = node->children[0];
+			while (lvalueNode->children.size() > 2)
+				lvalueNode = lvalueNode->children[1];
+
+			// sub case: lvalue → ID (a dead store only evaluates a value with effects)
+			if (lvalueNode->children.size() == 1) {
+				std::string id;
+				std::istringstream(lvalueNode->children[0]->seq) >> id >> id;
+				if (table.reads.count(id) != 0 || has_effects(node->children[2]))
+					number_value(node->children[2], table, avail, reuses);
+				kill_values(avail, table, id);
+				if (table.addressed.count(id) != 0) kill_values(avail, table, "");
+
+			// sub case: lvalue → STAR factor
+			} else {
+				number_value(node->children[2], table, avail, reuses);
+				number_value(lvalueNode->children[1], table, avail, reuses);
+				kill_values(avail, table, "");
+			}
+		}
+	}
+
+	void number_value(Node *node, ProcData &table, std::map<std::string,Node*> &avail, std::vector<std::pair<Node*,Node*>> &reuses) {
+		if (reload.count(node) != 0) return;
+
+		std::string key;
+		bool costly = is_costly(node);
+		if (costly) {
+			key = expr_key(node);
+			if (avail.count(key) != 0) {
+				reuses.emplace_back(node, avail[key]);
+				return;
+			}
+		}
+
+		// factor → ID LPAREN RPAREN
+		// factor → ID LPAREN arglist RPAREN
+		// factor → NEW INT LBRACK expr RBRACK
+		if (node->kind == "factor" && node->children.size() > 1
+				&& (node->children[0]->kind == "ID" || node->children[0]->kind == "NEW")) {
+			Node *argNode = (node->children[0]->kind == "NEW") ? node->children[3] : node->children[2];
+			for (; argNode->kind == "arglist"; argNode = argNode->children.back()) {
+				number_value(argNode->children[0], table, avail, reuses);
+				if (argNode->children.size() == 1) break;
+			}
+			if (argNode->kind == "expr") number_value(argNode, table, avail, reuses);
+			kill_values(avail, table, "");
+			return;
+
+		// factor → AMP lvalue (only the address under a dereference is ever evaluated)
+		} else if (node->kind == "factor" && node->children[0]->kind == "AMP") {
+			Node *lvalueNode = node->children[1];
+			while (lvalueNode->children.size() > 2)
+				lvalueNode = lvalueNode->children[1];
+			if (lvalueNode->children.size() == 2) number_value(lvalueNode->children[1], table, avail, reuses);
+			return;
+		}
+
+		std::vector<Node*> children = node->children;
+		if (right_first(node, table)) std::swap(children[0], children[2]);
+		for (Node *c : children) {
+			if (c->kind == "expr" || c->kind == "term" || c->kind == "factor")
+				number_value(c, table, avail, reuses);
+		}
+		/* a value with effects (a call or allocation) is computed again each time */
+		if (costly && !has_effects(node)) avail[key] = node;
+	}
+
+	/** drop the values reading variable id - or with no id, those that a memory write or call may change **/
+	void kill_values(std::map<std::string,Node*> &avail, ProcData &table, const std::string &id) {
+		for (auto it = avail.begin(); it != avail.end(); ) {
+			if (reads_value(it->second, table, id)) it = avail.erase(it);
+			else ++it;
+		}
+	}
+
+	bool reads_value(Node *node, ProcData &table, const std::string &id) {
+		// factor → STAR factor
+		if (id.empty() && node->kind == "factor" && node->children[0]->kind == "STAR") return true;
+
+		// factor → ID
+		if (node->kind == "ID") {
+			std::string varID;
+			std::istringstream(node->seq) >> varID >> varID;
+			return (id.empty()) ? table.addressed.count(varID) != 0 : varID == id;
+		}
+		for (Node *c : node->children)
+			if (reads_value(c, table, id)) return true;
+		return false;
+	}
+
+	/** unique key of an expression within a procedure - its kind and source text **/
+	std::string expr_key(Node *node) {
+		std::string key = node->kind;
+		std::vector<Node*> work = {node};
+		while (!work.empty()) {
+			Node *n = work.back();
+			work.pop_back();
+			if (n->children.empty()) {
+				key += " " + n->seq.substr(n->seq.find(' ') + 1);
+			} else {
+				for (auto it = n->children.rbegin(); it != n->children.rend(); ++it) work.push_back(*it);
+			}
+		}
+		return key;
+	}
+
+	/** whether evaluating the expression can have effects beyond its value (calls or allocation) **/
+	bool has_effects(Node *node) {
+		if (node->kind == "factor" && node->children.size() > 1
+				&& (node->children[0]->kind == "ID" || node->children[0]->kind == "NEW"))
+			return true;
+		for (Node *c : node->children)
+			if (has_effects(c)) return true;
+		return false;
+	}
+
 	/************************************/
 	/** code generation helper-methods **/
 	/************************************/
@@ -246,49 +1504,314 @@ class WLP4ParseTree {
 	//  $3 - return value and intermediate result (MUTABLE)
 	//  $4 - 4 (CONST)
 	//  $5 - previous intermediate result or print address (MUTABLE)
-	//  $6 - scratch register (MUTABLE)
-	//  $7 - scratch register (MUTABLE)
+	//  $6 - first variable of a leaf procedure (MUTABLE)
 	//    ...
+	// $10 - fifth variable of a leaf procedure (MUTABLE)
 	// $11 - 1 (CONST)
 	//    ...
 	// $29 - frame pointer, fp (SPECIAL)
 	// $30 - stack pointer, sp (SPECIAL, initially 0x01000000)
 	// $31 - return addr,   ra (SPECIAL, initially 0x8123456c)
 
-	void push(std::ostream &out, int r) {
-		out << "\t\tsw $" << r << ", -4($30)" << std::endl;
-		out << "\t\tsub $30, $30, $4" << std::endl;
+	/** whether a register keeps its value while an expression is evaluated - constants (pinned too), **/
+	/** and the variables of leaf procedures (expressions never assign, and leaves never call) **/
+	bool is_stable(int r) {
+		return r == 0 || r == 4 || r == 11 || (r >= MIN_VAR_REG && r <= MAX_VAR_REG) || (r > maxReg && r <= top_reg());
+	}
+
+	/** store to a variable, in its register or frame slot **/
+	void store(Code &out, int r, VarData &var) {
+		if (var.reg == 0) {
+			frame_sw(out, r, var.loc);
+		} else if (var.reg != r) {
+			out.add(var.reg, r, 0);
+		}
+	}
+
+	void push(Code &out, int r) {
+		out.sw(r, -4, 30);
+		out.sub(30, 30, 4);
+		++spDepth;
 	}
 
-	void pop(std::ostream &out, int r) {
-		out << "\t\tadd $30, $30, $4" << std::endl;
-		out << "\t\tlw $" << r << ", -4($30)" << std::endl;
+	void pop(Code &out, int r) {
+		out.add(30, 30, 4);
+		out.lw(r, -4, 30);
+		--spDepth;
 	}
 
-	void generate_prog_level(std::ostream &out, Node *node) {
+	/** last stack register - $29 too, when not the frame pointer **/
+	int top_reg() {
+		return (options.omitFp) ? OMIT_FP_MAX_REG : MAX_REG;
+	}
+
+	/** load from, and store to a frame slot - relative to fp, or with the frame pointer omitted, **/
+	/** relative to sp past whatever is pushed (see Code::rebase) **/
+	void frame_lw(Code &out, int r, int loc) {
+		if (options.omitFp) out.lw(r, loc + 4 * spDepth, Code::FRAME);
+		else out.lw(r, loc, 29);
+	}
+
+	void frame_sw(Code &out, int r, int loc) {
+		if (options.omitFp) out.sw(r, loc + 4 * spDepth, Code::FRAME);
+		else out.sw(r, loc, 29);
+	}
+
+	/** address of a frame slot, in d - except the first slot with a frame pointer, which is fp itself **/
+	int frame_addr(Code &out, int d, int loc) {
+		if (options.omitFp) {
+			out.lis(d);
+			out.frame_word(loc + 4 * spDepth);
+			out.add(d, 30, d);
+		} else if (loc == 0) {
+			return 29;
+		} else if (loc == -4) {
+			out.sub(d, 29, 4);
+		} else {
+			int constReg = generate_const(out, loc, d);
+			out.add(d, 29, constReg);
+		}
+		return d;
+	}
+
+	/** move sp back to just past the frame, where the caller left it **/
+	void release_frame(Code &out) {
+		if (options.omitFp) {
+			out.lis(5);
+			out.frame_word(4 + 4 * spDepth);
+			out.add(30, 30, 5);
+		} else {
+			out.add(30, 29, 4);
+		}
+	}
+
+	/** slot of the frame saving ra, above the one saving fp at each call (if any) **/
+	int ra_slot() {
+		return (options.omitFp) ? 0 : 4;
+	}
+
+	void generate_prog_level(Code &out, Node *node) {
 		// start → BOF procedures EOF
 		if (node->kind == "start") {
-			out << "\t\t.import print" << std::endl;
-			out << "\t\t.import init" << std::endl;
-			out << "\t\t.import new" << std::endl;
-			out << "\t\t.import delete" << std::endl;
-			out << "\t\tlis $4"  << std::endl;
-			out << "\t\t.word 4" << std::endl;
-			out << "\t\tlis $11" << std::endl;
-			out << "\t\t.word 1" << std::endl;
-			out << "\t\tbeq $0, $0, Fwain" << std::endl;
-			generate_prog_level(out, node->children[1]);
+			if (!options.runtime) {
+				out.import("print");
+				out.import("init");
+				out.import("new");
+				out.import("delete");
+			}
+			out.lis(4);
+			out.word(4);
+			out.lis(11);
+			out.word(1);
+			out.beq(0, 0, "Fwain");
+
+			/* optimizing: with -Os, a first generation finds which shared stubs save more words than */
+			/* they take, and a second one goes through them */
+			OptStats before = stats;
+			std::set<std::string> calledBefore = called;
+			std::vector<Code> code = generate_all();
+			if (options.size) {
+				choose_stubs();
+				if (!callStubs.empty() || returnStub) {
+					stats = before;
+					called = calledBefore;
+					code = generate_all();
+				}
+			}
+			for (Code &c : code) out.append(c);
+			generate_stubs(out);
+			if (options.instrument) generate_profile(out);
+
+			/* the shipped runtime follows the program, its heap starting after it */
+			if (options.runtime) {
+				out.note("\n\n\n");
+				out.source(WLP4_RUNTIME_PRINT);
+				out.source(WLP4_RUNTIME_HEAP);
+			}
+		}
+	}
 
-		// procedures → main
-		// procedures → procedure procedures
-		} else {
-			generate_proc(out, node->children[0]);
-			if (node->children.size() > 1)
-				generate_prog_level(out, node->children[1]);
+	/** generate each reachable procedure on its own (by one of the workers, each with a generator **/
+	/** state of its own), then keep the code of those still called, adding up their statistics **/
+	std::vector<Code> generate_all() {
+		std::vector<Code> code(procs.size());
+		std::vector<std::set<std::string>> calls(procs.size());
+		std::vector<OptStats> procStats(procs.size());
+		std::atomic<int> next(0);
+		int workerC = std::max(1, std::min(options.jobs, (int) reachable.size() / PROCS_PER_WORKER));
+		std::vector<WLP4ParseTree> workers(workerC, *this);
+		std::vector<std::thread> threads;
+		for (int w = 1; w < workerC; ++w)
+			threads.emplace_back(&WLP4ParseTree::generate_procs, &workers[w],
+								 std::ref(next), std::ref(code), std::ref(calls), std::ref(procStats));
+		workers[0].generate_procs(next, code, calls, procStats);
+		for (std::thread &t : threads) t.join();
+
+		/* procedures only call earlier procedures (or themselves), so going from wain */
+		/* backwards sees every remaining call to a procedure before it is reached - then */
+		/* emit in source order */
+		for (int k = ((int) procs.size()) - 1; k >= 0; --k) {
+			std::string procID;
+			std::istringstream(procs[k]->children[1]->seq) >> procID >> procID;
+
+			/* optimizing: only emit procedures reachable from wain */
+			if (reachable.count(procID) == 0) {
+				++stats.deadProcs;
+
+			/* optimizing: drop procedures whose every call was inlined */
+			} else if (procID != "wain" && called.count(procID) == 0) {
+				++stats.inlinedProcs;
+				code[k] = Code();
+
+			} else {
+				called.insert(calls[k].begin(), calls[k].end());
+				stats += procStats[k];
+			}
 		}
+		return code;
+	}
+
+	/** with -Os, keep the shared stubs saving more words (over the calls and epilogues of the last **/
+	/** generation) than they take **/
+	void choose_stubs() {
+		callStubs.clear();
+		for (auto &kv : stats.callGains)
+			if (kv.second > call_stub_words(kv.first)) callStubs.insert(kv.first);
+		returnStub = stats.returnGain > RETURN_STUB_WORDS;
+	}
+
+	/** label of the stub calling with the given number of stack registers saved **/
+	std::string call_stub(int n) {
+		return "Scall" + std::to_string(n);
+	}
+
+	/** slot of the frame saving the ra of a call through a stub, just above the slot saving ra (the **/
+	/** registers it saves follow) - wain keeps the ra slot too when calling through a stub **/
+	int stub_slot() {
+		return ra_slot() + 4;
 	}
 
-	void generate_proc(std::ostream &out, Node *node) {
+	/** words of the stub calling with n stack registers saved **/
+	int call_stub_words(int n) {
+		return 2 * n + ((options.omitFp) ? 4 : 7);
+	}
+
+	/** the shared stubs chosen - each call stub saves its stack registers and the ra of the call site, **/
+	/** sets fp and calls the procedure in $5, then restores them all; the return tail reloads ra and **/
+	/** releases the frame (past the reload of ra for procedures that never call out), sp moving by $5 **/
+	/** with the frame pointer omitted **/
+	void generate_stubs(Code &out) {
+		for (int n : callStubs) {
+			out.note("\n\n\n");
+			out.label(call_stub(n));
+			for (int k = 0; k < n; ++k)
+				out.sw(MIN_REG + k, stub_slot() + 4 * (k + 1), 30);
+			out.sw(31, stub_slot(), 30);
+			if (!options.omitFp) {
+				out.sw(29, 0, 30);
+				out.sub(29, 30, 4);
+			}
+			out.jalr(5);
+			if (!options.omitFp) out.lw(29, 0, 30);
+			out.lw(31, stub_slot(), 30);
+			for (int k = 0; k < n; ++k)
+				out.lw(MIN_REG + k, stub_slot() + 4 * (k + 1), 30);
+			out.jr(31);
+			stats.outlinedWords += stats.callGains[n] - call_stub_words(n);
+		}
+		if (returnStub) {
+			out.note("\n\n\n");
+			out.label("Sreturn");
+			out.lw(31, ra_slot(), 30);
+			out.label("Srelease");
+			if (options.omitFp) out.add(30, 30, 5);
+			else out.add(30, 29, 4);
+			out.jr(31);
+			stats.outlinedWords += stats.returnGain - RETURN_STUB_WORDS;
+		}
+	}
+
+	/** the profile counters, and the routine wain calls on exit writing them to the output device, one **/
+	/** line "<proc> <point> <runs>" each - the key of each counter is kept as a word per character, **/
+	/** ended by a 0 word, with the counter right after it **/
+	void generate_profile(Code &out) {
+		out.note("\n\n\n");
+		out.label("Pdump");
+		push(out, 31);
+		push(out, 6);
+		out.lis(6);
+		out.word("Pcounters");
+		out.label("Pdump_line");
+		out.lw(1, 0, 6);
+		out.beq(1, 0, "Pdump_end");
+		out.lis(5);
+		out.word(0xffff000c);
+		out.label("Pdump_key");
+		out.sw(1, 0, 5);
+		out.add(6, 6, 4);
+		out.lw(1, 0, 6);
+		out.bne(1, 0, "Pdump_key");
+		out.lw(1, 4, 6);
+		out.add(6, 6, 4);
+		out.add(6, 6, 4);
+		out.lis(5);
+		out.word("print");
+		out.jalr(5);
+		out.beq(0, 0, "Pdump_line");
+		out.label("Pdump_end");
+		pop(out, 6);
+		pop(out, 31);
+		out.jr(31);
+
+		out.label("Pcounters");
+		for (Node *node : procs) {
+			std::string procID;
+			std::istringstream(node->children[1]->seq) >> procID >> procID;
+			if (reachable.count(procID) == 0) continue;
+			for (std::string &point : ptable[procID].points) {
+				for (char ch : procID + " " + point + " ") out.word(ch);
+				out.word(0);
+				out.label(count_label(procID, point));
+				out.word(0);
+			}
+		}
+		out.word(0);
+	}
+
+	/** label of the counter of a profile point **/
+	std::string count_label(const std::string &procID, const std::string &point) {
+		return "P" + procID + "_" + point;
+	}
+
+	/** count a run of a profile point, if instrumenting - only $3 and $5 change, which hold nothing **/
+	/** live between statements (nor at the start of a procedure or inlined body) **/
+	void generate_count(Code &out, const std::string &procID, const std::string &point) {
+		if (!options.instrument) return;
+		out.lis(5);
+		out.word(count_label(procID, point));
+		out.lw(3, 0, 5);
+		out.add(3, 3, 11);
+		out.sw(3, 0, 5);
+	}
+
+	/** worker loop - take the next procedure not yet taken, until none remain, and generate it **/
+	/** if reachable (each into its own buffer, so the results never depend on the order) **/
+	void generate_procs(std::atomic<int> &next, std::vector<Code> &code,
+						std::vector<std::set<std::string>> &calls, std::vector<OptStats> &procStats) {
+		for (int k = next++; k < (int) procs.size(); k = next++) {
+			std::string procID;
+			std::istringstream(procs[k]->children[1]->seq) >> procID >> procID;
+			if (reachable.count(procID) == 0) continue;
+
+			called.clear();
+			stats = OptStats();
+			generate_proc(code[k], procs[k]);
+			calls[k].swap(called);
+			procStats[k] = stats;
+		}
+	}
+
+	void generate_proc(Code &out, Node *node) {
 		// main → INT WAIN LPAREN dcl COMMA dcl RPAREN LBRACE dcls statements RETURN expr SEMI RBRACE
 		// procedure → INT ID LPAREN params RPAREN LBRACE dcls statements RETURN expr SEMI RBRACE
 
@@ -299,69 +1822,301 @@ class WLP4ParseTree {
 		std::istringstream(node->children[1]->seq) >> procID >> procID;
 		ProcData &table = ptable[procID];
 
+		/* procedure body - generated first, since inlining may grow the frame */
+		Code body;
+		frameTop = frameSize = (int) table.symTable.size();
+		spDepth = 0;
+		stubSlots = 0;
+		frameLabel = (table.staticFrame) ? "D" + procID : "";
+		selfTail = false;
+		labelBase = "F" + procID + "_";
+		ifC = whileC = deleteC = newC = printC = loopDepth = 0;
+		pin_constants(node, table, isMain);
+		linkSlots = !table.frameless && (may_link(node->children[i+1], table, 0, 0) || may_link(node->children[i+3], table, 0, 0));
+		if (table.frameless) ++stats.framelessProcs;
+		for (auto &kv : table.symTable)
+			if (kv.second.reg != 0) ++stats.regVars;
+		generate_dcls(body, node->children[i], table);
+		generate_stmts(body, node->children[i+1], table);
+		int r = generate_expr(body, node->children[i+3], table);
+		if (r != 3)
+			body.add(3, r, 0);
+
+		/* a procedure that calls out ends its frame with the slots saving ra (on entry, except wain, which */
+		/* saves it above its frame) and fp (at each call, unless omitted), at ra_slot() and 0 from sp */
+		/* whenever nothing is pushed */
+		/* - calls through a stub save the ra of the call site and their stack registers right above them */
+		/* - a frame at a fixed address only needs the slot saving ra, as its last (fp is set again after */
+		/* each call) */
+		if (stubSlots > 0) frameSize += stub_slot() / 4 + stubSlots;
+		else if (linkSlots && table.staticFrame) ++frameSize;
+		else if (linkSlots) frameSize += ((isMain) ? 0 : 1) + ((options.omitFp) ? 0 : 1);
+		int raLoc = -4 * (frameSize - 1);
+
+
+
+
+		/* procedure prologue  */
+		/* if main function, then store the parameters directly from registers */
+		/* otherwise, no code for param - only args require code, will be supplied from caller */
+		out.note("\n\n\n");
+		out.label("F" + procID);
+		if (isMain) {
+			/* ra is saved above the frame */
+			out.sw(31, -4, 30);
+			out.sub(30, 30, 4);
+			if (!options.omitFp) out.sub(29, 30, 4);
+		}
+
+		/* optimizing: a frame at a fixed address leaves sp alone, fp pointing to its first slot */
+		if (table.staticFrame) {
+			out.lis(29);
+			out.word(frameLabel);
+			++stats.staticFrames;
+		}
+
+		/* update sp to point after the fully initialized stack frame */
+		/* must consider space for args, local variables AND locals of inlined calls */
+		/* (before any slot is stored to, as slots may be addressed from sp) */
+		int offset = (table.frameless || table.staticFrame) ? 0 : frameSize * 4;
+		if (offset == 4) {
+			out.sub(30, 30, 4);
+
+		} else if (offset > 0) {
+			out.lis(3);
+			out.word(offset);
+			out.sub(30, 30, 3);
+		}
+		if (linkSlots && table.staticFrame) frame_sw(out, 31, raLoc);
+		else if (linkSlots && !isMain) out.sw(31, ra_slot(), 30);
+		if (isMain) {
+			frame_sw(out, 1, 0);
+			frame_sw(out, 2, -4);
+		}
+
+		/* load the params kept in registers - a frameless leaf finds them relative to sp */
+		/* (params passed in registers stay in them, or else go to their frame slot) */
+		for (int k = 0; k < (int) table.params.size(); ++k) {
+			VarData &var = table[table.params[k]];
+			if (options.regArgs && k < REG_ARGS) {
+				if (var.reg == 0 && table.reads.count(table.params[k]) != 0)
+					frame_sw(out, MIN_VAR_REG + k, var.loc);
+				continue;
+			}
+			if (var.reg == 0) continue;
+			if (table.frameless) out.lw(var.reg, var.loc - 4, 30);
+			else frame_lw(out, var.reg, var.loc);
+		}
+
+		/* initialize the heap allocator */
+		if (isMain) {
+			if (node->children[3]->children[1]->type == TYPE_INT) {
+				out.add(2, 0, 0);
+			}
+			out.lis(5);
+			out.word("init");
+			out.jalr(5);
+		}
+
+		/* load the pinned constants, saving the registers they replace */
+		for (auto &pin : pinned) {
+			if (pinSlot >= 0)
+				frame_sw(out, pin.second, pin_loc(pin.second));
+			out.lis(pin.second);
+			out.word(pin.first);
+		}
+
+
+
+
+		/* procedure body - self-recursive tail calls jump back to the start of it */
+		out.note("\n\n");
+		generate_count(out, procID, "entry");
+		if (selfTail) out.label(labelBase + "tail");
+		out.append(body);
+
+		/* an instrumented wain writes out the profile before returning */
+		if (isMain && options.instrument) {
+			push(out, 3);
+			out.lis(5);
+			out.word("Pdump");
+			out.jalr(5);
+			pop(out, 3);
+		}
+
 
 
 
-		/* procedure prologue  */
-		/* if main function, then store the parameters directly from registers */
-		/* otherwise, no code for param - only args require code, will be supplied from caller */
-		out << std::endl << std::endl << std::endl << "F" << procID << ":" << std::endl;
-		if (isMain) {
-			push(out, 31);
-			out << "\t\tsub $29, $30, $4" << std::endl;
-			out << "\t\tsw $1, 0($29)" << std::endl;
-			out << "\t\tsw $2, -4($29)" << std::endl;
+		/* procedure epilogue */
+		out.note("\n\n");
+		restore_pins(out);
+		/* optimizing: with -Os, the epilogues of procedures with a frame may share their end */
+		bool shared = options.size && !isMain && !table.frameless && !table.staticFrame;
+		if (table.staticFrame) {
+			if (linkSlots) frame_lw(out, 31, raLoc);
+			out.jr(31);
+		} else if (shared && returnStub) {
+			if (options.omitFp) {
+				out.lis(5);
+				out.frame_word(4 + 4 * spDepth);
+			}
+			out.beq(0, 0, (linkSlots) ? "Sreturn" : "Srelease");
+		} else {
+			if (linkSlots && !isMain) out.lw(31, ra_slot(), 30);
+			if (isMain) {
+				frame_lw(out, 1, 0);
+				frame_lw(out, 2, -4);
+			}
+			if (!table.frameless) release_frame(out);
+			if (isMain) {
+				out.add(30, 30, 4);
+				out.lw(31, -4, 30);
+				out.add(29, 30, 0);
+			}
+			out.jr(31);
 		}
 
-		/* update sp to point after the fully initialized stack frame */
-		/* must consider space for args AND local variables */
-		int offset = ((int) table.symTable.size()) * 4;
-		if (offset == 4) {
-			out << "\t\tsub $30, $30, $4" << std::endl;
+		/* optimizing: without a frame pointer, frame slots are addressed from sp */
+		if (options.omitFp && !table.frameless) {
+			out.rebase(4 * (frameSize - 1));
+			++stats.spFrames;
+		}
 
-		} else if (offset > 0) {
-			out << "\t\tlis $3" << std::endl;
-			out << "\t\t.word " << offset << std::endl;
-			out << "\t\tsub $30, $30, $3" << std::endl;
+		/* optimizing: thread jumps through jumps, and drop jumps to the next instruction */
+		out.layout(stats.threadedJumps, stats.droppedInsts);
+
+		/* the epilogue shares its end unless dropped, as procedures ending in a tail call never reach it */
+		Instruction end = out.last();
+		if (shared && ((end.op == Op::jr && end.s == 31) || end.label == "Sreturn" || end.label == "Srelease"))
+			stats.returnGain += (linkSlots) ? 2 : 1;
+
+		/* optimizing: reorder independent instructions to hide load and multiply latencies */
+		out.schedule(options.cycles, stats.savedCycles);
+
+		/* a frame at a fixed address follows the code, its label at the first slot (slots go down) */
+		if (table.staticFrame) {
+			out.note("\n");
+			for (int k = 1; k < frameSize; ++k) out.word(0);
+			out.label(frameLabel);
+			out.word(0);
 		}
+	}
 
-		/* initialize the heap allocator */
-		if (isMain) {
-			if (node->children[3]->children[1]->type == TYPE_INT) {
-				out << "\t\tadd $2, $0, $0" << std::endl;
+	/** pick the constants worth a register for the whole procedure - each use saves a lis and .word, **/
+	/** while a pin costs loading it, and unless the register is otherwise unused, saving and restoring **/
+	/** it on entry and exit, and around each call to a procedure that may clobber it **/
+	void pin_constants(Node *node, ProcData &table, bool isMain) {
+		pinned.clear();
+		pinSlot = -1;
+		maxReg = top_reg();
+
+		std::map<int,int> uses;
+		std::vector<std::pair<std::string,int>> calls;
+		count_consts(node, table.id, uses, calls, 1);
+		std::vector<std::pair<int,int>> hot;
+		for (auto &kv : uses) hot.emplace_back(-kv.second, kv.first);
+		std::sort(hot.begin(), hot.end());
+
+		/* leaves use their spare variable registers - otherwise the stack registers above the deepest expression */
+		int firstReg = MIN_VAR_REG;
+		int lastReg = MAX_VAR_REG;
+		if (table.leaf) {
+			for (auto &kv : table.symTable) firstReg = std::max(firstReg, kv.second.reg + 1);
+		} else {
+			firstReg = MIN_REG + count_regs(node, table);
+			lastReg = top_reg();
+		}
+
+		int reg = lastReg;
+		for (auto &h : hot) {
+			if (reg < firstReg || (int) pinned.size() >= CONST_MAX_REGS) break;
+			int cost = 2;
+			if (!table.leaf) {
+				if (!isMain) cost += 2;
+				for (auto &call : calls) {
+					if (reg < MIN_REG + ptable[call.first].regs) cost += 2 * call.second;
+				}
 			}
-			out << "\t\tlis $5" << std::endl;
-			out << "\t\t.word init" << std::endl;
-			out << "\t\tjalr $5" << std::endl;
+			if (2 * -h.first <= cost) continue;
+			pinned[h.second] = reg--;
+			++stats.pinnedConsts;
 		}
 
+		/* pinned stack registers are restored before returning, so the frame also saves them */
+		if (!table.leaf) {
+			maxReg = reg;
+			if (!isMain && !pinned.empty()) {
+				pinSlot = frameTop;
+				frameTop = frameSize = frameTop + (int) pinned.size();
+			}
+		}
+	}
 
+	/** count the constants to materialize (in a procedure), weighting uses within loops - or with **/
+	/** a profile, by how often each arm and loop body ran **/
+	void count_consts(Node *node, const std::string &procID, std::map<int,int> &uses,
+					  std::vector<std::pair<std::string,int>> &calls, int weight) {
+		// statement → IF LPAREN test RPAREN LBRACE statements RBRACE ELSE LBRACE statements RBRACE
+		// statement → WHILE LPAREN test RPAREN LBRACE statements RBRACE
+		if (node->kind == "statement" && (node->children[0]->kind == "IF" || node->children[0]->kind == "WHILE")) {
+			int cond = fold_test(node->children[2]);
+			int thenWeight = weight, elseWeight = weight;
+			if (node->children[0]->kind == "WHILE") {
+				if (cond == 0) return;
+				weight = thenWeight = arm_weight(node, procID, "", weight);
+			} else {
+				thenWeight = arm_weight(node, procID, "_then", weight);
+				elseWeight = arm_weight(node, procID, "_else", weight);
+			}
+			if (cond < 0) count_consts(node->children[2], procID, uses, calls, weight);
+			if (cond != 0) count_consts(node->children[5], procID, uses, calls, thenWeight);
+			if (cond != 1 && node->children[0]->kind == "IF") count_consts(node->children[9], procID, uses, calls, elseWeight);
+			return;
 
+		// factor → ID LPAREN RPAREN
+		// factor → ID LPAREN arglist RPAREN
+		// (the calls that pins may need saving around, unless the call is inlined or in tail position)
+		} else if (node->kind == "factor" && node->children[0]->kind == "ID" && node->children.size() > 1) {
+			std::string procID;
+			std::istringstream(node->children[0]->seq) >> procID >> procID;
+			if (tailCalls.count(node) == 0 && !inlinable(procID))
+				calls.emplace_back(procID, weight);
 
-		/* procedure body */
-		out << std::endl << std::endl;
-		generate_dcls(out, node->children[i], table);
-		generate_stmts(out, node->children[i+1], table);
-		int r = generate_expr(out, node->children[i+3], table);
-		if (r != 3)
-			out << "\t\tadd $3, $" << r << ", $0" << std::endl;
+		// factor → NUM
+		// dcl BECOMES NUM
+		} else if (node->kind == "NUM") {
+			std::string str;
+			std::istringstream(node->seq) >> str >> str;
+			int val = std::stoi(str);
+			if (val != 0 && val != 1 && val != 4) uses[val] += weight;
+			return;
+		}
 
+		for (Node *c : node->children) count_consts(c, procID, uses, calls, weight);
+	}
 
+	/** frame offset of the slot saving a pinned register **/
+	int pin_loc(int reg) {
+		return -4 * (pinSlot + top_reg() - reg);
+	}
 
+	void restore_pins(Code &out) {
+		if (pinSlot < 0) return;
+		for (auto &pin : pinned)
+			frame_lw(out, pin.second, pin_loc(pin.second));
+	}
 
-		/* procedure epilogue */
-		out << std::endl << std::endl;
-		out << "\t\tadd $30, $29, $4" << std::endl;
-		if (isMain) {
-			out << "\t\tlw $1, 0($29)" << std::endl;
-			out << "\t\tlw $2, -4($29)" << std::endl;
-			pop(out, 31);
-			out << "\t\tadd $29, $30, $0" << std::endl;
+	/** pinned stack registers that a call may clobber, so are saved around it **/
+	std::vector<int> clobbered_pins(const std::string &procID) {
+		std::vector<int> regs;
+		for (auto &pin : pinned) {
+			if (pin.second > maxReg && pin.second < MIN_REG + ptable[procID].regs)
+				regs.push_back(pin.second);
 		}
-		out << "\t\tjr $31" << std::endl;
+		return regs;
 	}
 
-	void generate_dcls(std::ostream &out, Node *node, ProcData &table) {
+	void generate_dcls(Code &out, Node *node, ProcData &table) {
 		// dcls → ε
 		// dcls → dcls dcl BECOMES NUM SEMI
 		// dcls → dcls dcl BECOMES NULL SEMI
@@ -371,144 +2126,419 @@ class WLP4ParseTree {
 		}
 	}
 
-	void generate_dcl(std::ostream &out, Node *node, ProcData &table, Node *valNode) {
+	void generate_dcl(Code &out, Node *node, ProcData &table, Node *valNode) {
 		// type → INT
 		// type → INT STAR
 		// dcl → type ID
 		std::string id;
 		std::istringstream (node->children[1]->seq) >> id >> id;
+
+		/* optimizing: never read, so the initial value is a dead store */
+		if (table.reads.count(id) == 0) {
+			++stats.deadStores;
+			return;
+		}
 		int r = generate_token(out, valNode, table);
-		out << "\t\tsw $" << r << ", " << table[id].loc << "($29)" << std::endl;
+		store(out, r, table[id]);
 	}
 
-	void generate_stmts(std::ostream &out, Node *node, ProcData &table) {
+	void generate_stmts(Code &out, Node *node, ProcData &table) {
 		// statements → ε
 		// statements → statements statement
-		if (node->children.size() > 0) {
-			generate_stmts(out, node->children[0], table);
-			generate_stmt(out, node->children[1], table);
+		std::vector<Node*> stmts;
+		for (; node->children.size() > 0; node = node->children[0])
+			stmts.push_back(node->children[1]);
+		std::reverse(stmts.begin(), stmts.end());
+
+		/* optimizing: reuse values within each run of statements up to a loop or branch */
+		unsigned int k = 0;
+		while (k < stmts.size()) {
+			std::vector<Node*> run, numbered;
+			while (k < stmts.size() && stmts[k]->children[0]->kind != "WHILE") {
+				run.push_back(stmts[k++]);
+				if (run.back()->children[0]->kind == "IF") break;
+			}
+			if (run.empty()) run.push_back(stmts[k++]);
+
+			int slotC = number_values(run, table, numbered);
+			for (Node *stmtNode : run) generate_stmt(out, stmtNode, table);
+
+			for (Node *n : numbered) {
+				reload.erase(n);
+				saves.erase(n);
+			}
+			frameTop -= slotC;
 		}
 	}
 
-	void generate_stmt(std::ostream &out, Node *node, ProcData &table) {
+	void generate_stmt(Code &out, Node *node, ProcData &table) {
 		/* produce a comment on the type of statement beforehand */
-		out << std::endl << "\t\t;; " << node->seq << std::endl;
+		out.note("\n\t\t;; " + node->seq + "\n");
 
 		// statement → PRINTLN LPAREN expr RPAREN SEMI
 		if (node->children[0]->kind == "PRINTLN") {
 			int r = generate_expr(out, node->children[2], table);
-			out << "\t\tadd $1, $" << r << ", $0" << std::endl;
-			push(out, 31);
-			out << "\t\tlis $5" << std::endl;
-			out << "\t\t.word print" << std::endl;
-			out << "\t\tjalr $5" << std::endl;
-			pop(out, 31);
+			out.add(1, r, 0);
+
+			/* optimizing: in loops, print inline - the body of the shipped print only changes */
+			/* registers that are free here, so it is copied as it is (with labels of its own) */
+			if (options.inlinePrint && loopDepth > 0) {
+				std::string body = WLP4_RUNTIME_PRINT_BODY;
+				std::string LABEL = labelBase + "print" + std::to_string(printC++) + "_";
+				for (size_t at = body.find("rt_print_"); at != std::string::npos; at = body.find("rt_print_", at))
+					body.replace(at, 9, LABEL);
+				out.source(body);
+				++stats.inlinedPrints;
+				return;
+			}
+
+			/* ra is saved once, on entry (see generate_proc) */
+			out.lis(5);
+			out.word("print");
+			out.jalr(5);
 
 		// statement → IF LPAREN test RPAREN LBRACE statements RBRACE ELSE LBRACE statements RBRACE
 		} else if (node->children[0]->kind == "IF") {
-			static int ifC = 0;
-			std::string LABEL = table.id + std::to_string(ifC++) + "IFELSE";
+			/* optimizing: only the live arm of a constant test is emitted */
+			std::string &point = points[node];
+			int cond = fold_test(node->children[2]);
+			if (cond >= 0) {
+				++stats.deadBranches;
+				generate_count(out, table.id, point + ((cond == 1) ? "_then" : "_else"));
+				generate_stmts(out, node->children[(cond == 1) ? 5 : 9], table);
+				return;
+			}
+
+			std::string LABEL = labelBase + "if" + std::to_string(ifC++);
 
-			generate_test(out, node->children[2], table);
-			out << "\t\tbeq $3, $0, " << LABEL << "FALSE" << std::endl;
+			/* optimizing: the arm laid out last needs no jump over the other, so it goes to */
+			/* the arm expected to run more (see then_last) */
+			if (then_last(node, table)) {
+				generate_test(out, node->children[2], table, LABEL + "_then", true);
 
+				generate_count(out, table.id, point + "_else");
+				generate_stmts(out, node->children[9], table);
+				out.beq(0, 0, LABEL + "_end");
+
+				out.label(LABEL + "_then");
+				generate_count(out, table.id, point + "_then");
+				generate_stmts(out, node->children[5], table);
+				out.label(LABEL + "_end");
+				++stats.swappedArms;
+				return;
+			}
+
+			generate_test(out, node->children[2], table, LABEL + "_false");
+
+			generate_count(out, table.id, point + "_then");
 			generate_stmts(out, node->children[5], table);
-			out << "\t\tbeq $0, $0, " << LABEL << "TRUE" << std::endl;
+			out.beq(0, 0, LABEL + "_true");
 
-			out << LABEL << "FALSE:" << std::endl;
+			out.label(LABEL + "_false");
+			generate_count(out, table.id, point + "_else");
 			generate_stmts(out, node->children[9], table);
-			out << LABEL << "TRUE:" << std::endl;
+			out.label(LABEL + "_true");
 
 		// statement → WHILE LPAREN test RPAREN LBRACE statements RBRACE
 		} else if (node->children[0]->kind == "WHILE") {
-			static int whileC = 0;
-			std::string LABEL = table.id + std::to_string(whileC++) + "WHILE";
+			/* optimizing: a constantly false loop is dropped, a constantly true one needs no test */
+			int cond = fold_test(node->children[2]);
+			if (cond == 0) {
+				++stats.deadBranches;
+				return;
+			}
+
+			std::string LABEL = labelBase + "while" + std::to_string(whileC++);
 
-			out << LABEL << "BODY:" << std::endl;
-			generate_test(out, node->children[2], table);
-			out << "\t\tbeq $3, $0, " << LABEL << "END" << std::endl;
+			/* optimizing: compute loop-invariant expressions once, in a preheader */
+			std::vector<Node*> invariants;
+			int slotC = generate_preheader(out, node, table, cond < 0, invariants);
 
+			/* optimizing: the test follows the body, branching back while it holds - entered by */
+			/* a jump to the test, so each iteration only takes the one branch */
+			if (cond < 0) out.beq(0, 0, LABEL + "_test");
+			out.label(LABEL + "_body");
+
+			++loopDepth;
+			generate_count(out, table.id, points[node]);
 			generate_stmts(out, node->children[5], table);
-			out << "\t\tbeq $0, $0, " << LABEL << "BODY" << std::endl;
-			out << LABEL << "END:" << std::endl;
+			--loopDepth;
+			if (cond < 0) {
+				out.label(LABEL + "_test");
+				generate_test(out, node->children[2], table, LABEL + "_body", true);
+				++stats.rotatedLoops;
+			} else {
+				out.beq(0, 0, LABEL + "_body");
+			}
+
+			for (Node *inv : invariants) reload.erase(inv);
+			frameTop -= slotC;
 
 		// statement → DELETE LBRACK RBRACK expr SEMI
 		} else if (node->children[0]->kind == "DELETE") {
-			static int deleteC = 0;
-			std::string LABEL = table.id + std::to_string(deleteC++) + "DELETE";
+			std::string LABEL = labelBase + "delete" + std::to_string(deleteC++);
 			int r = generate_expr(out, node->children[3], table);
 
-			out << "\t\tbeq $" << r << ", $11, " << LABEL << std::endl;
-			out << "\t\tadd $1, $" << r << ", $0" << std::endl;
+			/* arena mode never frees, so only the expression itself is kept */
+			if (options.arena) return;
 
-			push(out, 31);
-			out << "\t\tlis $5" << std::endl;
-			out << "\t\t.word delete" << std::endl;
-			out << "\t\tjalr $5" << std::endl;
-			pop(out, 31);
-			out << LABEL << ":" << std::endl;
+			out.beq(r, 11, LABEL);
+			out.add(1, r, 0);
+
+			out.lis(5);
+			out.word("delete");
+			out.jalr(5);
+			out.label(LABEL);
 
 		// statement → lvalue BECOMES expr SEMI
 		} else {
 			// sub case: lvalue → LPAREN lvalue RPAREN
-			int r = generate_expr(out, node->children[2], table);
 			Node *lvalueNode = node->children[0];
 			while (lvalueNode->children.size() > 2)
 				lvalueNode = lvalueNode->children[1];
 
+			/* optimizing: assigning to a variable that is never read is a dead store */
+			if (lvalueNode->children.size() == 1) {
+				std::string id;
+				std::istringstream(lvalueNode->children[0]->seq) >> id >> id;
+				if (table.reads.count(id) == 0) {
+					++stats.deadStores;
+					if (has_effects(node->children[2]))
+						generate_expr(out, node->children[2], table);
+					return;
+				}
+			}
+			int r = generate_expr(out, node->children[2], table);
+
 			// sub case: lvalue → ID
 			if (lvalueNode->children.size() == 1) {
 				std::string id;
 				std::istringstream(lvalueNode->children[0]->seq) >> id >> id;
-				int offset = table[id].loc;
-				out << "\t\tsw $" << r << ", " << offset << "($29)" << std::endl;
+				store(out, r, table[id]);
 
 			// sub case: lvalue → STAR factor
 			} else {
-				push(out, r);
-				r = generate_factor(out, lvalueNode->children[1], table);
-				pop(out, 5);
-				out << "\t\tsw $5, 0($" << r << ")" << std::endl;
+				/* the value is held in a stack register (or pushed, once they run out) while the */
+				/* address is computed */
+				bool pushed = false;
+				if (!is_stable(r) && stackReg <= maxReg) {
+					out.add(stackReg, r, 0);
+					r = stackReg++;
+				} else if (!is_stable(r)) {
+					push(out, r);
+					++stacked;
+					pushed = true;
+				}
+				int q = generate_factor(out, lvalueNode->children[1], table);
+				if (pushed) {
+					pop(out, r = 5);
+					--stacked;
+				}
+				out.sw(r, 0, q);
+				if (r >= MIN_REG && r <= maxReg) --stackReg;
+			}
+		}
+	}
+
+	/** whether to lay the THEN arm of an IF out last, so it runs without a jump - never when the ELSE **/
+	/** arm is empty, and always when the THEN arm is (a jump to the end right after it is dropped), **/
+	/** else when the profile found the THEN arm hotter, or without one, for NE tests (which mostly hold, **/
+	/** as EQ tests mostly fail) **/
+	bool then_last(Node *node, ProcData &table) {
+		// statement → IF LPAREN test RPAREN LBRACE statements RBRACE ELSE LBRACE statements RBRACE
+		if (node->children[9]->children.empty()) return false;
+		if (node->children[5]->children.empty()) return true;
+
+		long long thenRuns = profile_runs(table.id, points[node] + "_then");
+		long long elseRuns = profile_runs(table.id, points[node] + "_else");
+		if (thenRuns >= 0 && elseRuns >= 0) return thenRuns > elseRuns;
+		return node->children[2]->children[1]->kind == "NE";
+	}
+
+	/** store each loop-invariant expression of the loop to a fresh frame slot - return the slot count **/
+	/** (the slots stay reserved past frameTop until the caller drops them after the loop) **/
+	int generate_preheader(Code &out, Node *node, ProcData &table, bool hasTest, std::vector<Node*> &invariants) {
+		// statement → WHILE LPAREN test RPAREN LBRACE statements RBRACE
+		if (table.frameless) return 0;
+		LoopData loop;
+		std::map<Node*,bool> inv;
+		std::vector<Node*> found;
+		std::map<std::string,int> slots;
+
+		scan_loop(node, loop);
+		if (hasTest) {
+			find_invariant(node->children[2], table, loop, true, inv);
+			collect_invariant(node->children[2], inv, found);
+		}
+		find_invariant(node->children[5], table, loop, false, inv);
+		collect_invariant(node->children[5], inv, found);
+
+		int slotC = 0;
+		for (Node *n : found) {
+			std::string key = expr_key(n);
+			if (slots.count(key) == 0) {
+				int r = (n->kind == "expr") ? generate_expr(out, n, table)
+					  : (n->kind == "term") ? generate_term(out, n, table)
+					  : generate_factor(out, n, table);
+				slots[key] = -4 * (frameTop + slotC++);
+				frame_sw(out, r, slots[key]);
+				++stats.hoistedExprs;
 			}
+			reload[n] = slots[key];
+			invariants.push_back(n);
+		}
+
+		frameTop += slotC;
+		frameSize = std::max(frameSize, frameTop);
+		return slotC;
+	}
+
+	/** compute one operand of a binary operation (side 0 the left, side 2 the right) - int operands of **/
+	/** pointer arithmetic are scaled to bytes **/
+	int generate_operand(Code &out, Node *node, int side, ProcData &table) {
+		Node *operand = node->children[side];
+		int r = (operand->kind == "expr") ? generate_expr(out, operand, table)
+			  : (operand->kind == "term") ? generate_term(out, operand, table)
+			  : generate_factor(out, operand, table);
+
+		// sub case: typeof(expr, op, term) = (int, +, int*)
+		// sub case: typeof(expr, op, term) = (int*, ±, int)
+		if (node->kind == "expr" && operand->type == TYPE_INT && node->children[2 - side]->type == TYPE_INT_PTR) {
+			out.mult(r, 4);
+			out.mflo(r = 3);
+		}
+		return r;
+	}
+
+	/** pushes computing a subtree makes from stack register sr on, with its operands ordered (or with **/
+	/** ordered off, always left first) - not counting those of calls, which ordering never crosses **/
+	int count_pushes(Node *node, ProcData &table, int sr, bool ordered) {
+		std::set<int> pending, seen;
+		for (auto &kv : saves) pending.insert(kv.second);
+		return count_pushes(node, table, sr, ordered, pending, seen);
+	}
+
+	int count_pushes(Node *node, ProcData &table, int sr, bool ordered, std::set<int> &pending, std::set<int> &seen) {
+		/* values reused within the subtree are computed wherever first reached (so depending on the */
+		/* order), and reloaded elsewhere - as are values computed earlier */
+		if (saves.count(node) != 0 || reload.count(node) != 0) {
+			int slot = (saves.count(node) != 0) ? saves[node] : reload[node];
+			if (pending.count(slot) == 0 || !seen.insert(slot).second) return 0;
+		}
+
+		// factor → ID LPAREN RPAREN
+		// factor → ID LPAREN arglist RPAREN
+		int pushes = 0;
+		if (node->kind == "factor" && node->children[0]->kind == "ID" && node->children.size() > 1) return 0;
+		if (!is_binary(node)) {
+			for (Node *c : node->children) pushes += count_pushes(c, table, sr, ordered, pending, seen);
+			return pushes;
+		}
+		int first = (ordered && right_first(node, table)) ? 2 : 0;
+		pushes = count_pushes(node->children[first], table, sr, ordered, pending, seen);
+		if (!stable_operand(node, table, inlineDepth > 0, first)) {
+			if (sr <= maxReg) ++sr;
+			else ++pushes;
+		}
+		return pushes + count_pushes(node->children[2 - first], table, sr, ordered, pending, seen);
+	}
+
+	/** compute both operands of a binary operation, the left into q and the right into r - constants and **/
+	/** leaf variables need not be saved while the other operand is computed, others are held in a stack **/
+	/** register (or pushed, once they run out, and popped to $5) - return the register held, for the **/
+	/** caller to free once the operation is done **/
+	int generate_operands(Code &out, Node *node, ProcData &table, int &q, int &r) {
+		bool inlined = (inlineDepth > 0);
+		int left = count_regs(node->children[0], table, inlined), right = count_regs(node->children[2], table, inlined);
+		bool rightFirst = right_first(node, table, inlined, left, right);
+		if (rightFirst) ++stats.reorderedOps;
+		if (operandDepth == 0)
+			stats.spillsAvoided += count_pushes(node, table, stackReg, false) - count_pushes(node, table, stackReg, true);
+
+		/* STACK REGISTER OPTIMIZATION */
+		int first = (rightFirst) ? 2 : 0;
+		int &a = (rightFirst) ? r : q;		// operand computed first
+		int &b = (rightFirst) ? q : r;
+		bool pushed = false;
+		++operandDepth;
+		a = generate_operand(out, node, first, table);
+		if (!is_stable(a) && stackReg <= maxReg) {
+			/* use reg now to access the first operand instead of popping to $5 */
+			out.add(stackReg, a, 0);
+			a = stackReg++;
+		} else if (!is_stable(a)) {
+			/* retain old system when stack registers are exhausted */
+			push(out, a);
+			++stacked;
+			pushed = true;
 		}
+		b = generate_operand(out, node, 2 - first, table);
+		--operandDepth;
+		if (pushed) {
+			pop(out, a = 5);
+			--stacked;
+		}
+		/* STACK REGISTER OPTIMIZATION */
+		return a;
 	}
 
-	/** always return test result in $3 **/
-	void generate_test(std::ostream &out, Node *node, ProcData &table) {
-		int r;
+	/** branch to label whenever the test fails (or with onTrue, whenever it holds) - comparison is **/
+	/** fused into the branch itself, so no boolean is ever materialized for IF or WHILE **/
+	void generate_test(Code &out, Node *node, ProcData &table, const std::string &label, bool onTrue = false) {
+		int q, r;
 		std::string &kind = node->children[1]->kind;
-		std::string op = (node->children[0]->type == TYPE_INT_PTR) ? "sltu" : "slt";
+		Op op = (node->children[0]->type == TYPE_INT_PTR) ? Op::sltu : Op::slt;
 
-		r = generate_expr(out, node->children[0], table);
-		push(out, r);
-		r = generate_expr(out, node->children[2], table);
-		pop(out, 5);
+		int held = generate_operands(out, node, table, q, r);
+		if (held >= MIN_REG && held <= maxReg) --stackReg;
+
+		// test → expr EQ expr
+		// test → expr NE expr
+		if (kind == "EQ" || kind == "NE") {
+			out.branch(((kind == "EQ") != onTrue) ? Op::bne : Op::beq, q, r, label);
+			return;
 
 		// test → expr LT expr
 		// test → expr GE expr
-		if (kind == "LT" || kind == "GE") {
-			out << "\t\t" << op << " $3, $5, $" << r << std::endl;
+		} else if (kind == "LT" || kind == "GE") {
+			out.op3(op, 3, q, r);
 
 		// test → expr GT expr
 		// test → expr LE expr
-		} else if (kind == "GT" || kind == "LE") {
-			out << "\t\t" << op << " $3, $" << r << ", $5" << std::endl;
-
-		// test → expr NE expr
-		// test → expr EQ expr
 		} else {
-			out << "\t\t" << op << " $6, $5, $" << r << std::endl;
-			out << "\t\t" << op << " $7, $" << r << ", $5" << std::endl;
-			out << "\t\tadd $3, $6, $7" << std::endl;
+			out.op3(op, 3, r, q);
 		}
 
-		if (kind == "GE" || kind == "LE" || kind == "EQ")
-			out << "\t\tsub $3, $11, $3" << std::endl;
+		/* LT and GT fail on a cleared slt, GE and LE fail on a set slt */
+		if ((kind == "LT" || kind == "GT") != onTrue)
+			out.beq(3, 0, label);
+		else
+			out.bne(3, 0, label);
+	}
+
+	/** reload a value computed ahead of its loop **/
+	int generate_reload(Code &out, Node *node) {
+		frame_lw(out, 3, reload[node]);
+		return 3;
+	}
+
+	/** compute a value reloaded later in its run of statements, and save it to its slot **/
+	int generate_save(Code &out, Node *node, ProcData &table) {
+		int slot = saves[node];
+		saves.erase(node);
+		int r = (node->kind == "expr") ? generate_expr(out, node, table)
+			  : (node->kind == "term") ? generate_term(out, node, table)
+			  : generate_factor(out, node, table);
+		frame_sw(out, r, slot);
+		return r;
 	}
 
 	/** For all expression generation methods, return value is the register **/
 	/** number containing the value ($3 by default, or others when optimizing) **/
-	int generate_expr(std::ostream &out, Node *node, ProcData &table) {
+	int generate_expr(Code &out, Node *node, ProcData &table) {
+		if (reload.count(node) != 0) return generate_reload(out, node);
+		if (saves.count(node) != 0) return generate_save(out, node, table);
+
 		// expr → term
 		if (node->children.size() == 1)
 			return generate_term(out, node->children[0], table);
@@ -525,74 +2555,39 @@ class WLP4ParseTree {
 			std::istringstream(right->seq) >> str >> y;
 
 			x = (node->children[1]->kind == "PLUS") ? x + y : x - y;
-			out << "\t\tlis $3" << std::endl;
-			out << "\t\t.word " << x << std::endl;
-			return 3;
+			return generate_const(out, x, 3);
 
 		// expr → expr PLUS term
 		// expr → expr MINUS term
 		} else {
-			int q = 5;	// register holding left hand side calculation prior to performing operation
+			int q;		// register holding left hand side calculation prior to performing operation
 			int r;		// register holding right hand side calculation prior to performing operation
 			bool isPlus = (node->children[1]->kind == "PLUS");		// otherwise MINUS
 			bool ptrArith = (isPlus)
 						  ? (node->children[0]->type != node->children[2]->type)
 						  : (node->children[0]->type == TYPE_INT_PTR);
-			std::string op = (isPlus) ? "add" : "sub";
-
-			// sub case: typeof(expr, op, term) = (int, ±, int)
-			r = generate_expr(out, node->children[0], table);
-			if (ptrArith && node->children[0]->type == TYPE_INT) {
-				// sub case: typeof(expr, op, term) = (int, +, int*)
-				out << "\t\tmult $" << r << ", $4" << std::endl;
-				out << "\t\tmflo $" << (r = 3) << std::endl;
-			}
-
-			/* STACK REGISTER OPTIMIZATION */
-			// std::cerr << "\t\t\033[0;31m (" << MIN_REG << ", " << stackReg << ", " << MAX_REG << ") \033[0m" << std::endl;
-			if (stackReg <= MAX_REG) {
-				/* use reg now to access first param instead of popping to $5 */
-				out << "\t\tadd $" << stackReg << ", $" << r << ", $0" << std::endl;
-				q = stackReg++;
-			} else {
-				/* retain old system when stack registers are exhausted */
-				push(out, r);
-				++stacked;
-			}
-			// std::cerr << "\t\t\033[0;31m (" << MIN_REG << ", " << stackReg << ", " << MAX_REG << ") \033[0m" << std::endl;
-			/* STACK REGISTER OPTIMIZATION */
-
-			r = generate_term(out, node->children[2], table);
-			if (ptrArith && node->children[2]->type == TYPE_INT) {
-				// sub case: typeof(expr, op, term) = (int*, ±, int)
-				out << "\t\tmult $" << r << ", $4" << std::endl;
-				out << "\t\tmflo $" << (r = 3) << std::endl;
-			}
-
-			/* STACK REGISTER OPTIMIZATION */
-			if (q == 5) {
-				/* was no more stack registers, retrieve from actual stack */
-				pop(out, 5);
-				--stacked;
-			}
-			/* STACK REGISTER OPTIMIZATION */
+			Op op = (isPlus) ? Op::add : Op::sub;
 
-			out << "\t\t" << op << " $3, $" << q << ", $" << r << std::endl;
+			int held = generate_operands(out, node, table, q, r);
+			out.op3(op, 3, q, r);
 			if (ptrArith && node->children[0]->type == node->children[2]->type) {
 				// sub case: typeof(expr, op, term) = (int*, -, int*)
-				out << "\t\tdiv $3, $4" << std::endl;
-				out << "\t\tmflo $3" << std::endl;
+				out.op2(Op::div, 3, 4);
+				out.mflo(3);
 			}
 
 			/* STACK REGISTER OPTIMIZATION */
 			/* free stack register if used */
-			if (q != 5) --stackReg;
+			if (held >= MIN_REG && held <= maxReg) --stackReg;
 			/* STACK REGISTER OPTIMIZATION */
 			return 3;
 		}
 	}
 
-	int generate_term(std::ostream &out, Node *node, ProcData &table) {
+	int generate_term(Code &out, Node *node, ProcData &table) {
+		if (reload.count(node) != 0) return generate_reload(out, node);
+		if (saves.count(node) != 0) return generate_save(out, node, table);
+
 		// term → factor
 		if (node->children.size() == 1)
 			return generate_factor(out, node->children[0], table);
@@ -611,55 +2606,34 @@ class WLP4ParseTree {
 
 			x = (node->children[1]->kind == "STAR") ? x * y
 			  : (node->children[1]->kind == "SLASH") ? x / y : x % y;
-			out << "\t\tlis $3" << std::endl;
-			out << "\t\t.word " << x << std::endl;
-			return 3;
+			return generate_const(out, x, 3);
 
 		// term → term STAR factor
 		// term → term SLASH factor
 		// term → term PCT factor
 		} else {
-			int q = 5;
+			int q;
 			int r;
-			std::string op = (node->children[1]->kind == "STAR") ? "mult" : "div";
-			std::string mf = (node->children[1]->kind == "PCT") ? "mfhi" : "mflo";
-
-			r = generate_term(out, node->children[0], table);
-			/* STACK REGISTER OPTIMIZATION */
-			// std::cerr << "\t\t\033[0;31m (" << MIN_REG << ", " << stackReg << ", " << MAX_REG << ") \033[0m" << std::endl;
-			if (stackReg <= MAX_REG) {
-				/* use reg now to access first param instead of popping to $5 */
-				out << "\t\tadd $" << stackReg << ", $" << r << ", $0" << std::endl;
-				q = stackReg++;
-			} else {
-				/* retain old system when stack registers are exhausted */
-				push(out, r);
-				++stacked;
-			}
-			// std::cerr << "\t\t\033[0;31m (" << MIN_REG << ", " << stackReg << ", " << MAX_REG << ") \033[0m" << std::endl;
-			/* STACK REGISTER OPTIMIZATION */
+			Op op = (node->children[1]->kind == "STAR") ? Op::mult : Op::div;
+			Op mf = (node->children[1]->kind == "PCT") ? Op::mfhi : Op::mflo;
 
-			r = generate_factor(out, node->children[2], table);
-			/* STACK REGISTER OPTIMIZATION */
-			if (q == 5) {
-				/* was no more stack registers, retrieve from actual stack */
-				pop(out, 5);
-				--stacked;
-			}
-			/* STACK REGISTER OPTIMIZATION */
+			int held = generate_operands(out, node, table, q, r);
 
-			out << "\t\t" << op << " $" << q << ", $" << r << std::endl;
-			out << "\t\t" << mf << " $3" << std::endl;
+			out.op2(op, q, r);
+			out.op1(mf, 3);
 
 			/* STACK REGISTER OPTIMIZATION */
 			/* free stack register if used */
-			if (q != 5) --stackReg;
+			if (held >= MIN_REG && held <= maxReg) --stackReg;
 			/* STACK REGISTER OPTIMIZATION */
 			return 3;
 		}
 	}
 
-	int generate_factor(std::ostream &out, Node *node, ProcData &table) {
+	int generate_factor(Code &out, Node *node, ProcData &table) {
+		if (reload.count(node) != 0) return generate_reload(out, node);
+		if (saves.count(node) != 0) return generate_save(out, node, table);
+
 		// factor → NUM
 		// factor → ID
 		// factor → NULL
@@ -686,89 +2660,459 @@ class WLP4ParseTree {
 			// sub case: lvalue → ID
 			std::string id;
 			std::istringstream(lvalueNode->children[0]->seq) >> id >> id;
-			int offset = table[id].loc;
-			if (offset == 0) return 29;
-
-			if (offset == -4) {
-				out << "\t\tsub $3, $29, $4" << std::endl;
-			} else {
-				out << "\t\tlis $3" << std::endl;
-				out << "\t\t.word " << offset << std::endl;
-				out << "\t\tadd $3, $29, $3" << std::endl;
-			}
+			return frame_addr(out, 3, table[id].loc);
 
 		// factor → STAR factor
 		} else if (node->children[0]->kind == "STAR") {
 			int r = generate_factor(out, node->children[1], table);
-			out << "\t\tlw $3, 0($" << r << ")" << std::endl;
+			out.lw(3, 0, r);
 
 		// factor → NEW INT LBRACK expr RBRACK
 		} else if (node->children[0]->kind == "NEW") {
 			int r = generate_expr(out, node->children[3], table);
-			out << "\t\tadd $1, $" << r << ", $0" << std::endl;
+			out.add(1, r, 0);
+
+			/* optimizing: in arena mode, bump the top of the heap inline - the runtime is only */
+			/* called past the arena limit, or for no words at all */
+			std::string LABEL = (options.arena) ? labelBase + "new" + std::to_string(newC++) : "";
+			if (options.arena) {
+				out.add(3, 1, 1);
+				out.add(3, 3, 3);
+				out.lis(5);
+				out.word("rt_heap");
+				out.lw(2, 4, 5);
+				out.add(3, 2, 3);
+				out.lw(5, 12, 5);
+				out.op3(Op::sltu, 5, 5, 3);
+				out.bne(5, 0, LABEL + "_call");
+				out.op3(Op::sltu, 5, 2, 3);
+				out.beq(5, 0, LABEL + "_call");
+				out.lis(5);
+				out.word("rt_heap");
+				out.sw(3, 4, 5);
+				out.add(3, 2, 0);
+				out.beq(0, 0, LABEL);
+				out.label(LABEL + "_call");
+				++stats.bumpedNews;
+			}
 
-			push(out, 31);
-			out << "\t\tlis $5" << std::endl;
-			out << "\t\t.word new" << std::endl;
-			out << "\t\tjalr $5" << std::endl;
-			pop(out, 31);
+			out.lis(5);
+			out.word("new");
+			out.jalr(5);
 
-			out << "\t\tbne $3, $0, 1" << std::endl;
-			out << "\t\tadd $3, $11, $0" << std::endl;
+			out.bne(3, 0, 1);
+			out.add(3, 11, 0);
+			if (options.arena) out.label(LABEL);
 
 		// factor → ID LPAREN RPAREN
 		// factor → ID LPAREN arglist RPAREN
 		} else {
-			int pushC = 3;			// 1 + number of registers to preserve
 			std::string procID;
 			std::istringstream(node->children[0]->seq) >> procID >> procID;
 
-			/* save fp, ra, and any stack registers using mass push */
-				// push(out, 29);
-				// push(out, 31);
-			out << "\t\tsw $29, -4($30)" << std::endl;
-			out << "\t\tsw $31, -8($30)" << std::endl;
-			for (int sr = MIN_REG; sr < stackReg; ++sr, ++pushC)
-				out << "\t\tsw $" << sr << ", -" << (4 * pushC) << "($30)" << std::endl;
-			out << "\t\tlis $5" << std::endl;
-			out << "\t\t.word " << (4 * (pushC-1)) << std::endl;
-			out << "\t\tsub $30, $30, $5" << std::endl;
-
-			/* compute and store each arg, then set new fp */
-			if (node->children[2]->kind == "arglist") {
-				int argc = generate_args(out, node->children[2], table);
-				if (argc == 1) {
-					out << "\t\tadd $30, $30, $4" << std::endl;
-				} else {
-					out << "\t\tlis $5" << std::endl;
-					out << "\t\t.word " << (4 * argc) << std::endl;
-					out << "\t\tadd $30, $30, $5" << std::endl;
-				}
+			/* optimizing: substitute small non-recursive procedures at the call site */
+			if (inlinable(procID))
+				return generate_inline(out, node, table, ptable[procID]);
+			called.insert(procID);
+
+			/* optimizing: calls in tail position reuse the frame of the caller */
+			/* wain restores its own registers before returning, so its frame is never reused */
+			if (tailCalls.count(node) != 0 && inlineDepth == 0 && table.id != "wain" && stacked == 0) {
+				generate_tail_call(out, node, table, procID);
+				return 3;
+			}
+
+			/* values pushed once stack registers ran out lie below the frame, so the callee frame */
+			/* goes below them, moving sp */
+			if (stacked > 0) {
+				generate_pushed_call(out, node, table, procID);
+				return 3;
 			}
-			out << "\t\tsub $29, $30, $4" << std::endl;
+
+			/* optimizing: args are computed straight to where the callee finds them, and the */
+			/* registers kept across the call go to frame slots (fp to the bottom one, while ra is */
+			/* saved on entry), so the call sequence never moves sp */
+			/* a frameless callee leaves fp alone, reading its args relative to sp (as every callee */
+			/* does with the frame pointer omitted), and a callee with a frame at a fixed address sets */
+			/* fp itself - a caller with such a frame sets its own fp again, rather than saving it */
+			bool frameless = ptable[procID].frameless;
+			if (node->children[2]->kind == "arglist")
+				generate_call_args(out, node, table);
+
+			/* optimizing: only the stack registers the callee may clobber are saved */
+			int savedReg = std::min(stackReg, MIN_REG + ptable[procID].regs);
+			stats.savesSkipped += stackReg - savedReg;
+			bool setFp = !frameless && !ptable[procID].staticFrame && !options.omitFp;
+			bool saveFp = !frameless && !options.omitFp && frameLabel.empty();
+
+			/* optimizing: with -Os, calls longer than one through a stub go through the shared stub */
+			/* saving as many stack registers (each count with a stub of its own, see generate_stubs) */
+			int n = savedReg - MIN_REG;
+			int words = 2 * n + 3 + ((saveFp) ? 2 : 0) + ((setFp) ? 1 : 0);
+			bool stub = false;
+			if (options.size && frameLabel.empty() && words > STUB_CALL_WORDS) {
+				stats.callGains[n] += words - STUB_CALL_WORDS;
+				stub = callStubs.count(n) != 0;
+			}
+			std::vector<int> saved;
+			for (int sr = MIN_REG; sr < savedReg && !stub; ++sr)
+				saved.push_back(sr);
+			for (int pr : clobbered_pins(procID))
+				saved.push_back(pr);
+			int base = frameTop;
+			frameTop += (int) saved.size();
+			frameSize = std::max(frameSize, frameTop);
+
+			if (saveFp && !stub) out.sw(29, 0, 30);
+			for (int k = 0; k < (int) saved.size(); ++k)
+				frame_sw(out, saved[k], -4 * (base + k));
+			if (setFp && !stub) out.sub(29, 30, 4);
 
 			/* call procedure */
-			out << "\t\tlis $5" << std::endl;
-			out << "\t\t.word F" << procID << std::endl;
-			out << "\t\tjalr $5" << std::endl;
-
-			/* reset the stack */
-				// pop(out, 31);
-				// pop(out, 29);
-			out << "\t\tlis $5" << std::endl;
-			out << "\t\t.word " << (4 * (pushC-1)) << std::endl;
-			out << "\t\tadd $30, $30, $5" << std::endl;
-			out << "\t\tlw $29, -4($30)" << std::endl;
-			out << "\t\tlw $31, -8($30)" << std::endl;
-			pushC = 3;
-			for (int sr = MIN_REG; sr < stackReg; ++sr, ++pushC)
-				out << "\t\tlw $" << sr << ", -" << (4 * pushC) << "($30)" << std::endl;
+			out.lis(5);
+			out.word("F" + procID);
+			if (stub) {
+				out.lis(3);
+				out.word(call_stub(n));
+				out.jalr(3);
+				stubSlots = std::max(stubSlots, n + 1);
+			} else {
+				out.jalr(5);
+			}
+
+			if (saveFp && !stub) out.lw(29, 0, 30);
+			if (!frameless && !options.omitFp && !frameLabel.empty()) {
+				out.lis(29);
+				out.word(frameLabel);
+			}
+			for (int k = 0; k < (int) saved.size(); ++k)
+				frame_lw(out, saved[k], -4 * (base + k));
+			frameTop = base;
 		}
 		return 3;
 	}
 
+	/** small, non-recursive procedures are inlined, up to a nesting depth - with a profile, larger ones **/
+	/** too when hot, and none that never ran; with -Os, only those no larger than a call, unless called once **/
+	bool inlinable(const std::string &procID) { return inlinable(procID, inlineDepth); }
+	bool inlinable(const std::string &procID, int depth) {
+		ProcData &callee = ptable[procID];
+		long long runs = profile_runs(procID, "entry");
+		int maxNodes = (runs >= PROFILE_HOT_RUNS) ? INLINE_HOT_NODES : (runs == 0) ? 0 : INLINE_MAX_NODES;
+		if (options.size && callee.callSites > 1) maxNodes = std::min(maxNodes, INLINE_SIZE_NODES);
+		return depth < INLINE_MAX_DEPTH && callee.size <= maxNodes && recursive.count(procID) == 0;
+	}
+
+	/** whether the code of a subtree may call out, overwriting ra - calls neither inlined (at the given **/
+	/** depth) nor in tail position, and the runtime routines, except prints copied inline in loops **/
+	bool may_link(Node *node, ProcData &table, int depth, int loops) {
+		// statement → IF LPAREN test RPAREN LBRACE statements RBRACE ELSE LBRACE statements RBRACE
+		// statement → WHILE LPAREN test RPAREN LBRACE statements RBRACE
+		if (node->kind == "statement" && (node->children[0]->kind == "IF" || node->children[0]->kind == "WHILE")) {
+			bool isWhile = (node->children[0]->kind == "WHILE");
+			int cond = fold_test(node->children[2]);
+			if (isWhile && cond == 0) return false;
+			return (cond < 0 && may_link(node->children[2], table, depth, loops))
+				|| (cond != 0 && may_link(node->children[5], table, depth, (isWhile) ? loops + 1 : loops))
+				|| (cond != 1 && !isWhile && may_link(node->children[9], table, depth, loops));
+
+		// statement → PRINTLN LPAREN expr RPAREN SEMI
+		// statement → DELETE LBRACK RBRACK expr SEMI
+		// factor → NEW INT LBRACK expr RBRACK
+		} else if (node->kind == "PRINTLN") {
+			return !options.inlinePrint || loops == 0;
+		} else if (node->kind == "DELETE") {
+			return !options.arena;
+		} else if (node->kind == "NEW") {
+			return true;
+
+		// factor → ID LPAREN RPAREN
+		// factor → ID LPAREN arglist RPAREN
+		} else if (node->kind == "factor" && node->children[0]->kind == "ID" && node->children.size() > 1) {
+			std::string procID;
+			std::istringstream(node->children[0]->seq) >> procID >> procID;
+			bool inlined = inlinable(procID, depth);
+			if (!inlined && (depth > 0 || tailCalls.count(node) == 0 || table.id == "wain")) return true;
+			for (Node *arg : arg_list(node))
+				if (may_link(arg, table, depth, loops)) return true;
+			if (!inlined) return false;
+
+			// procedure → INT ID LPAREN params RPAREN LBRACE dcls statements RETURN expr SEMI RBRACE
+			ProcData &callee = ptable[procID];
+			return may_link(callee.node->children[7], callee, depth + 1, loops)
+				|| may_link(callee.node->children[9], callee, depth + 1, loops);
+		}
+
+		for (Node *c : node->children)
+			if (may_link(c, table, depth, loops)) return true;
+		return false;
+	}
+
+	/** inline the callee body, with its params and locals remapped to fresh slots in the caller frame **/
+	int generate_inline(Code &out, Node *node, ProcData &table, ProcData &callee) {
+		// procedure → INT ID LPAREN params RPAREN LBRACE dcls statements RETURN expr SEMI RBRACE
+		int base = frameTop;
+		frameTop += (int) callee.symTable.size();
+		frameSize = std::max(frameSize, frameTop);
+
+		ProcData inlined = callee;
+		for (auto &kv : inlined.symTable) {
+			kv.second.loc -= 4 * base;
+			kv.second.reg = 0;
+		}
+		inlined.frameless = false;
+
+		/* store each arg straight into its param slot - slots are fresh, so order is irrelevant */
+		out.note("\t\t;; inline " + callee.id + "\n");
+		Node *argNode = (node->children[2]->kind == "arglist") ? node->children[2] : nullptr;
+		for (std::string &param : inlined.params) {
+			int r = generate_expr(out, argNode->children[0], table);
+			frame_sw(out, r, inlined[param].loc);
+			argNode = (argNode->children.size() > 1) ? argNode->children[2] : nullptr;
+		}
+
+		++inlineDepth;
+		generate_count(out, callee.id, "entry");
+		generate_dcls(out, callee.node->children[6], inlined);
+		generate_stmts(out, callee.node->children[7], inlined);
+		int r = generate_expr(out, callee.node->children[9], inlined);
+		--inlineDepth;
+
+		frameTop = base;
+		++stats.inlinedCalls;
+		return r;
+	}
+
+	/** overwrite the params in the current frame with the args, then jump into the callee **/
+	void generate_tail_call(Code &out, Node *node, ProcData &table, const std::string &procID) {
+		ProcData &callee = ptable[procID];
+		bool self = (procID == table.id);
+		int baseReg = stackReg;
+		std::vector<int> regs;
+
+		/* every arg is evaluated before any param is overwritten, since args may read them */
+		out.note("\t\t;; tail call " + procID + "\n");
+		Node *argNode = (node->children[2]->kind == "arglist") ? node->children[2] : nullptr;
+		for (unsigned int i = 0; i < callee.params.size(); ++i) {
+			/* passing a param back unchanged in place needs no code */
+			std::string id;
+			Node *argFactor = unwrap_factor(argNode->children[0]);
+			if (self && argFactor != nullptr && argFactor->children.size() == 1 && argFactor->children[0]->kind == "ID")
+				std::istringstream(argFactor->children[0]->seq) >> id >> id;
+
+			if (id == callee.params[i]) {
+				regs.push_back(0);
+			} else {
+				int r = generate_expr(out, argNode->children[0], table);
+				if (stackReg <= maxReg) {
+					out.add(stackReg, r, 0);
+					regs.push_back(stackReg++);
+				} else {
+					push(out, r);
+					++stacked;
+					regs.push_back(5);
+				}
+			}
+			argNode = (argNode->children.size() > 1) ? argNode->children[2] : nullptr;
+		}
+
+		/* the callee returns straight to our caller, so ra and pinned registers are restored first */
+		/* (before the args are stored, since args may overwrite the slots saving them) - ra is just */
+		/* above sp, past the args still pushed */
+		if (!self) restore_pins(out);
+		if (!self && linkSlots) out.lw(31, ra_slot() + 4 * spDepth, 30);
+
+		/* args spilled to the stack are the last ones, so pop them in reverse */
+		for (int i = ((int) regs.size()) - 1; i >= 0; --i) {
+			if (regs[i] == 0) continue;
+			if (regs[i] == 5) {
+				pop(out, 5);
+				--stacked;
+			}
+			if (options.regArgs && !self && i < REG_ARGS) out.add(MIN_VAR_REG + i, regs[i], 0);
+			else frame_sw(out, regs[i], -4 * i);
+		}
+		stackReg = baseReg;
+
+		if (self) {
+			/* the frame is already in place, so just restart the body */
+			selfTail = true;
+			out.beq(0, 0, labelBase + "tail");
+			++stats.tailRecursions;
+		} else {
+			/* callee starts with sp just past the reused frame, and returns straight to our caller */
+			release_frame(out);
+			out.lis(5);
+			out.word("F" + procID);
+			out.jr(5);
+			++stats.tailCalls;
+		}
+	}
+
+	/** call with values pushed below the frame - fp and the stack registers the callee may clobber are **/
+	/** pushed too, then the args past them, so the callee frame starts below all of them **/
+	void generate_pushed_call(Code &out, Node *node, ProcData &table, const std::string &procID) {
+		int pushC = 2;			// 1 + number of registers to preserve
+		bool saveFp = !ptable[procID].frameless && !options.omitFp;
+		bool setFp = saveFp && !ptable[procID].staticFrame;
+		if (saveFp) out.sw(29, -4, 30);
+		int savedReg = std::min(stackReg, MIN_REG + ptable[procID].regs);
+		stats.savesSkipped += stackReg - savedReg;
+		for (int sr = MIN_REG; sr < savedReg; ++sr, ++pushC)
+			out.sw(sr, -(4 * pushC), 30);
+		std::vector<int> savedPins = clobbered_pins(procID);
+		for (int pr : savedPins)
+			out.sw(pr, -(4 * pushC++), 30);
+		int constReg = generate_const(out, 4 * (pushC-1), 5);
+		out.sub(30, 30, constReg);
+		spDepth += pushC - 1;
+
+		/* compute and store each arg, then set new fp */
+		int argc = 0;
+		if (node->children[2]->kind == "arglist")
+			argc = (options.regArgs) ? generate_reg_args(out, node, table) : generate_args(out, node->children[2], table);
+		if (argc > 0) {
+			if (argc == 1) {
+				out.add(30, 30, 4);
+			} else {
+				int constReg = generate_const(out, 4 * argc, 5);
+				out.add(30, 30, constReg);
+			}
+			spDepth -= argc;
+		}
+
+		/* a callee frame at a fixed address takes the args left below sp */
+		if (ptable[procID].staticFrame && argc > 0) {
+			out.lis(5);
+			out.word("D" + procID);
+			for (int i = (options.regArgs) ? REG_ARGS : 0; i < argc; ++i) {
+				out.lw(3, -4 * (i + 1), 30);
+				out.sw(3, -4 * i, 5);
+			}
+		}
+		if (setFp) out.sub(29, 30, 4);
+
+		out.lis(5);
+		out.word("F" + procID);
+		out.jalr(5);
+
+		constReg = generate_const(out, 4 * (pushC-1), 5);
+		out.add(30, 30, constReg);
+		spDepth -= pushC - 1;
+		if (saveFp) out.lw(29, -4, 30);
+		pushC = 2;
+		for (int sr = MIN_REG; sr < savedReg; ++sr, ++pushC)
+			out.lw(sr, -(4 * pushC), 30);
+		for (int pr : savedPins)
+			out.lw(pr, -(4 * pushC++), 30);
+	}
+
+	/** compute the args of a call straight to where the callee finds them - the first REG_ARGS in their **/
+	/** registers with --reg-args, the others in the slots just below sp, which become the first of the **/
+	/** callee frame - holding an arg in a stack register or frame slot until every arg is computed if a **/
+	/** later arg may call (see held_args), or if it goes below sp and a later arg may push **/
+	void generate_call_args(Code &out, Node *node, ProcData &table) {
+		std::string procID;
+		std::istringstream(node->children[0]->seq) >> procID >> procID;
+		std::string frame = (ptable[procID].staticFrame) ? "D" + procID : "";
+
+		std::vector<Node*> args = arg_list(node);
+		std::vector<bool> held = held_args(args);
+		bool pushes = false;
+		for (int i = ((int) args.size()) - 1; i >= 0; --i) {
+			held[i] = held[i] || (pushes && frame.empty() && !(options.regArgs && i < REG_ARGS));
+			pushes = pushes || stackReg + i + count_regs(args[i], table, inlineDepth > 0) > maxReg + 1;
+		}
+
+		std::vector<int> homes(args.size(), 0);		// stack register, or (negative) frame slot offset
+		int baseReg = stackReg, baseTop = frameTop;
+		size_t baseAt = std::string::npos;
+		for (int i = 0; i < (int) args.size(); ++i) {
+			int r = generate_expr(out, args[i], table);
+			if (!held[i]) {
+				place_arg(out, i, r, frame, baseAt);
+			} else if (stackReg <= maxReg) {
+				out.add(stackReg, r, 0);
+				homes[i] = stackReg++;
+			} else {
+				homes[i] = -4 * frameTop++;
+				frameSize = std::max(frameSize, frameTop);
+				frame_sw(out, r, homes[i]);
+			}
+		}
+		for (int i = 0; i < (int) args.size(); ++i) {
+			if (!held[i]) continue;
+			int r = homes[i];
+			if (r < 0) frame_lw(out, r = 3, homes[i]);
+			place_arg(out, i, r, frame, baseAt);
+		}
+		stackReg = baseReg;
+		frameTop = baseTop;
+	}
+
+	/** move an arg to where the callee finds it - its register, its slot below sp, or its slot of the **/
+	/** callee frame at a fixed address (with the label frame), addressed through $5 - loaded again only **/
+	/** if changed since the end of the code at baseAt loading it **/
+	void place_arg(Code &out, int i, int r, const std::string &frame, size_t &baseAt) {
+		if (options.regArgs && i < REG_ARGS) {
+			out.add(MIN_VAR_REG + i, r, 0);
+		} else if (frame.empty()) {
+			out.sw(r, -4 * (i + 1), 30);
+		} else if (r == 5) {
+			out.lis(3);
+			out.word(frame);
+			out.sw(5, -4 * i, 3);
+		} else {
+			if (baseAt == std::string::npos || out.changed_since(baseAt, 5)) {
+				out.lis(5);
+				out.word(frame);
+				baseAt = out.size();
+			}
+			out.sw(r, -4 * i, 5);
+		}
+	}
+
+	/** with args in registers - move each of the first REG_ARGS args to its register (holding it in a **/
+	/** stack register or frame slot until every arg is computed, if a later arg may call), and push **/
+	/** the others past the slots of the first - return the words pushed or reserved (0 if none) **/
+	int generate_reg_args(Code &out, Node *node, ProcData &table) {
+		std::vector<Node*> args = arg_list(node);
+		std::vector<bool> held = held_args(args);
+		std::vector<int> homes(args.size(), 0);		// stack register, or (negative) frame slot offset
+		int baseReg = stackReg, baseTop = frameTop;
+
+		for (int i = 0; i < (int) args.size(); ++i) {
+			if (i == REG_ARGS) {
+				int constReg = generate_const(out, 4 * REG_ARGS, 5);
+				out.sub(30, 30, constReg);
+				spDepth += REG_ARGS;
+			}
+			int r = generate_expr(out, args[i], table);
+			if (i >= REG_ARGS) {
+				push(out, r);
+			} else if (!held[i]) {
+				out.add(MIN_VAR_REG + i, r, 0);
+			} else if (stackReg <= maxReg) {
+				out.add(stackReg, r, 0);
+				homes[i] = stackReg++;
+			} else {
+				homes[i] = -4 * frameTop++;
+				frameSize = std::max(frameSize, frameTop);
+				frame_sw(out, r, homes[i]);
+			}
+		}
+		for (int i = 0; i < (int) args.size(); ++i) {
+			if (!held[i]) continue;
+			if (homes[i] > 0) out.add(MIN_VAR_REG + i, homes[i], 0);
+			else frame_lw(out, MIN_VAR_REG + i, homes[i]);
+		}
+		stackReg = baseReg;
+		frameTop = baseTop;
+		return ((int) args.size() > REG_ARGS) ? (int) args.size() : 0;
+	}
+
 	/** return arg count - push the expression results onto frame in proper order **/
-	int generate_args(std::ostream &out, Node *node, ProcData &table, int i = 1) {
+	int generate_args(Code &out, Node *node, ProcData &table, int i = 1) {
 		// arglist → expr
 		// arglist → expr COMMA arglist
 		int r = generate_expr(out, node->children[0], table);
@@ -777,7 +3121,7 @@ class WLP4ParseTree {
 		return generate_args(out, node->children[2], table, i+1);
 	}
 
-	int generate_token(std::ostream &out, Node *node, ProcData &table) {
+	int generate_token(Code &out, Node *node, ProcData &table) {
 		// NUM || NULL || ID
 		std::string str;
 		std::istringstream(node->seq) >> str >> str;
@@ -786,19 +3130,25 @@ class WLP4ParseTree {
 			return 11;
 
 		} else if (node->kind == "ID")  {
-			out << "\t\tlw $3, " << table[str].loc << "($29)" << std::endl;
+			if (table[str].reg != 0) return table[str].reg;
+			frame_lw(out, 3, table[str].loc);
 			return 3;
 
 		} else {
-			int val = std::stoi(str);
-			if (val == 1) return 11;
-			if (val == 0 || val == 4) return val;
-			out << "\t\tlis $3" << std::endl;
-			out << "\t\t.word " << val << std::endl;
-			return 3;
+			return generate_const(out, std::stoi(str), 3);
 		}
 	}
 
+	/** return the register holding a constant - a constant register, a pinned one, or else scratch **/
+	int generate_const(Code &out, int val, int scratch) {
+		if (val == 1) return 11;
+		if (val == 0 || val == 4) return val;
+		if (pinned.count(val) != 0) return pinned[val];
+		out.lis(scratch);
+		out.word(val);
+		return scratch;
+	}
+
 	/*******************************************/
 	/** end of code generation helper-methods **/
 	/*******************************************/
@@ -806,16 +3156,60 @@ class WLP4ParseTree {
 	CFG &cfg;
 	Node *root;
 	std::map<std::string,ProcData> ptable;
+	std::vector<Node*> procs;				// procedure nodes, in source order
+	std::set<std::string> reachable;		// procedures reachable from wain
+	std::set<std::string> recursive;		// procedures that can call themselves
+	std::set<std::string> called;			// procedures with a remaining (not inlined) call site
+	std::set<Node*> tailCalls;				// call factors in tail position of their procedure
+	std::map<Node*,std::string> points;		// IF and WHILE statements, to their profile point ("if<k>", "while<k>")
+	std::map<std::string,long long> profile;	// runs of each profile point in the profiled runs, by "<proc> <point>"
+	std::map<Node*,int> reload;				// values already computed (hoisted or numbered), to the frame slot holding them
+	std::map<Node*,int> saves;				// values reloaded later in their run of statements, to the frame slot for them
+	OptStats stats;
 	int stackReg = MIN_REG;					// "stack register" - use as efficient quick global stack
 	int stacked = 0;						// if we run out of stack registers, resort to using stack as usual
+	int spDepth = 0;						// words sp is below the bottom of the frame (pushed, or for a call)
+	int frameTop = 0;						// next free frame slot (in words) of the current procedure
+	int frameSize = 0;						// frame size (in words) of the current procedure
+	int inlineDepth = 0;					// nesting depth of the inlined body being generated
+	int operandDepth = 0;					// nesting depth of the binary operands being generated
+	bool selfTail = false;					// whether the current procedure jumps back to its body
+	bool linkSlots = false;					// whether the current frame ends in the slots saving ra and fp around calls
+	std::map<int,int> pinned;				// constants held in a register by the current procedure, to that register
+	int pinSlot = -1;						// frame slot (in words) saving the first pinned register, if saved at all
+	int maxReg = MAX_REG;					// last stack register, below those pinned to constants
+	std::string labelBase;					// prefix of the labels of the current procedure ("F<proc>_")
+	int ifC = 0, whileC = 0, deleteC = 0, newC = 0, printC = 0;	// labels numbered so far in the current procedure
+	int loopDepth = 0;						// nesting depth of the loops around the statement being generated
+	std::set<int> callStubs;				// numbers of stack registers saved by calls through a shared stub (-Os)
+	bool returnStub = false;				// whether procedure epilogues end in the shared return tail (-Os)
+	int stubSlots = 0;						// slots (in words) the current frame keeps for the call stubs
+	std::string frameLabel;					// label of the frame of the current procedure, if at a fixed address
+	Options options;						// options of the code being generated
+	bool owner = true;						// whether the tree belongs to this generator (not to a copy)
   public:
 	WLP4ParseTree(CFG &cfg)
-		: cfg(cfg), root(nullptr), ptable(), stackReg(MIN_REG), stacked(0) {}
+		: cfg(cfg), root(nullptr), ptable(), procs(), reachable(), recursive(), called(), tailCalls(), points(), profile(),
+		  reload(), saves(), stats(),
+		  stackReg(MIN_REG), stacked(0), spDepth(0), frameTop(0), frameSize(0), inlineDepth(0), operandDepth(0), selfTail(false), linkSlots(false),
+		  pinned(), pinSlot(-1), maxReg(MAX_REG), labelBase(), ifC(0), whileC(0), deleteC(0), newC(0), printC(0), loopDepth(0),
+		  callStubs(), returnStub(false), stubSlots(0), frameLabel(), options(), owner(true) {}
 
 	WLP4ParseTree(const WLP4ParseTree &tree)
-		: cfg(tree.cfg), root(tree.root), ptable(tree.ptable), stackReg(tree.stackReg), stacked(tree.stacked) {}
-
-	~WLP4ParseTree() { delete root; }
+		: cfg(tree.cfg), root(tree.root), ptable(tree.ptable), procs(tree.procs), reachable(tree.reachable),
+		  recursive(tree.recursive), called(tree.called), tailCalls(tree.tailCalls), points(tree.points),
+		  profile(tree.profile), reload(tree.reload),
+		  saves(tree.saves),
+		  stats(tree.stats),
+		  stackReg(tree.stackReg), stacked(tree.stacked), spDepth(tree.spDepth), frameTop(tree.frameTop), frameSize(tree.frameSize),
+		  inlineDepth(tree.inlineDepth), operandDepth(tree.operandDepth), selfTail(tree.selfTail), linkSlots(tree.linkSlots),
+		  pinned(tree.pinned), pinSlot(tree.pinSlot),
+		  maxReg(tree.maxReg), labelBase(tree.labelBase), ifC(tree.ifC), whileC(tree.whileC), deleteC(tree.deleteC), newC(tree.newC),
+		  printC(tree.printC), loopDepth(tree.loopDepth),
+		  callStubs(tree.callStubs), returnStub(tree.returnStub), stubSlots(tree.stubSlots),
+		  frameLabel(tree.frameLabel), options(tree.options), owner(false) {}
+
+	~WLP4ParseTree() { if (owner) delete root; }
 
 	WLP4ParseTree &operator=(const WLP4ParseTree &tree) {
 		// cfg already exists
@@ -825,30 +3219,149 @@ class WLP4ParseTree {
 		return *this;
 	}
 
+	/** Set the options of the code to generate - before reading the tree, as the calling **/
+	/** convention already decides where the variables of leaf procedures are kept **/
+	void setOptions(const Options &opts) { options = opts; }
+
 	/** Main code generator **/
-	/** Output directly to stream **/
-	std::ostream &generate(std::ostream &out = std::cout) {
-		generate_prog_level(out, root);
+	/** Output directly to stream - as MIPS assembly, or as machine code assembled from the **/
+	/** instruction objects (a MERL module, each word as 4 bytes); procedures are generated **/
+	/** by up to options.jobs threads, with the same output whatever the number **/
+	std::ostream &generate(std::ostream &out) {
+		Code code;
+		generate_prog_level(code, root);
+		if (!options.machineCode) return out << code;
+
+		for (int64_t word : code.assemble())
+			out << ((char) (word >> 24)) << ((char) (word >> 16)) << ((char) (word >> 8)) << ((char) word);
 		return out;
 	}
 
+	/** Read a profile - lines "<proc> <point> <runs>", as an instrumented program writes them on exit **/
+	/** (other lines, such as the output of the program itself, are skipped; runs of the same point **/
+	/** add up, so profiles of several runs can simply be concatenated) - read before the tree **/
+	std::istream &readProfile(std::istream &in) {
+		std::string line;
+		while (getline(in, line)) {
+			std::istringstream iss(line);
+			std::string procID, point;
+			long long runs;
+			if (iss >> procID >> point >> runs) profile[procID + " " + point] += runs;
+		}
+		return in;
+	}
+
+	/** Report the optimization statistics of the last generation **/
+	std::ostream &printStats(std::ostream &err = std::cerr) {
+		err << "unreachable procedures removed: " << stats.deadProcs << std::endl;
+		err << "constant branches removed:      " << stats.deadBranches << std::endl;
+		err << "dead stores removed:            " << stats.deadStores << std::endl;
+		err << "calls inlined:                  " << stats.inlinedCalls << std::endl;
+		err << "procedures fully inlined:       " << stats.inlinedProcs << std::endl;
+		err << "tail calls reusing the frame:   " << stats.tailCalls << std::endl;
+		err << "tail recursions made jumps:     " << stats.tailRecursions << std::endl;
+		err << "loop invariants hoisted:        " << stats.hoistedExprs << std::endl;
+		err << "common subexpressions reused:   " << stats.reusedExprs << std::endl;
+		err << "leaf variables in registers:    " << stats.regVars << std::endl;
+		err << "leaf procedures without frame:  " << stats.framelessProcs << std::endl;
+		err << "caller saves skipped:           " << stats.savesSkipped << std::endl;
+		err << "constants pinned in registers:  " << stats.pinnedConsts << std::endl;
+		err << "allocations bumped inline:      " << stats.bumpedNews << std::endl;
+		err << "prints inlined in loops:        " << stats.inlinedPrints << std::endl;
+		err << "IF arms swapped for layout:     " << stats.swappedArms << std::endl;
+		err << "loops tested at the bottom:     " << stats.rotatedLoops << std::endl;
+		err << "jumps threaded:                 " << stats.threadedJumps << std::endl;
+		err << "jumps and dead code dropped:    " << stats.droppedInsts << std::endl;
+		err << "frames addressed from sp:       " << stats.spFrames << std::endl;
+		err << "operands reordered:             " << stats.reorderedOps << std::endl;
+		err << "spills avoided by reordering:   " << stats.spillsAvoided << std::endl;
+		err << "cycles saved by scheduling:     " << stats.savedCycles << std::endl;
+		err << "frames at fixed addresses:      " << stats.staticFrames << std::endl;
+		err << "constant params propagated:     " << stats.propagatedParams << std::endl;
+		err << "procedures cloned for consts:   " << stats.clonedProcs << std::endl;
+		err << "words saved by shared stubs:    " << stats.outlinedWords << std::endl;
+		return err;
+	}
+
 	friend std::istream &operator>>(std::istream &in, WLP4ParseTree &tree);
 };
 
 std::istream &operator>>(std::istream &in, WLP4ParseTree &tree) {
 	if (tree.root != nullptr) delete tree.root;
 	tree.root = tree.readTree(in);
-	tree.initptable(tree.root);
+	tree.points.clear();
+
+	/* procedure tables are built again once constants are propagated, over the procedures as changed */
+	for (int pass = 0; pass < 2; ++pass) {
+		tree.procs.clear();
+		tree.tailCalls.clear();
+		tree.ptable.clear();
+		if (pass > 0) tree.points.clear();
+		tree.initptable(tree.root);
+		tree.reachable.clear();
+		if (tree.ptable.count("wain") != 0) tree.initreachable("wain");
+		tree.recursive.clear();
+		tree.initrecursive();
+		if (pass > 0 || tree.ptable.count("wain") == 0 || !tree.initclones()) break;
+	}
+	tree.initescapes();
+	tree.initstatic();
+	tree.initregs();
 	return in;
 }
 
 
 
 
-int main() {
+int main(int argc, char *argv[]) {
 	std::string str, word;
+	bool showStats = false;
 	CFG wlp4cfg;
 	WLP4ParseTree tree(wlp4cfg);
+	WLP4ParseTree::Options options;
+	options.jobs = std::max(1, (int) std::thread::hardware_concurrency());
+
+	// options: --stats reports the applied optimizations to stderr
+	//         -c outputs machine code instead of assembly
+	//         -j N generates procedures on at most N threads (one for sequential generation)
+	//         --runtime bundles the shipped runtime (print, init, new, delete) into the program
+	//         --arena allocates from an arena inline, never freeing (bundling the runtime too)
+	//         --inline-print prints inline within loops (bundling the runtime too)
+	//         --profile-generate counts the runs of each procedure, IF arm and loop body, written out on exit
+	//         --profile-use FILE optimizes for the runs counted in FILE
+	//         --reg-args passes the first args of each call in registers
+	//         --omit-fp addresses frames from sp, using $29 as one more stack register
+	//         --cycle-model FILE schedules for the opcode latencies in FILE
+	//         -Os shares call sequences and epilogues in stubs, for smaller code
+	//         --static-frames gives non-recursive procedures a frame at a fixed address
+	for (int i = 1; i < argc; ++i) {
+		if (std::string(argv[i]) == "--stats") showStats = true;
+		if (std::string(argv[i]) == "-c") options.machineCode = true;
+		if (std::string(argv[i]) == "-j" && i + 1 < argc) options.jobs = std::max(1, std::atoi(argv[++i]));
+		if (std::string(argv[i]) == "--runtime") options.runtime = true;
+		if (std::string(argv[i]) == "--arena") options.runtime = options.arena = true;
+		if (std::string(argv[i]) == "--inline-print") options.runtime = options.inlinePrint = true;
+		if (std::string(argv[i]) == "--profile-generate") options.instrument = true;
+		if (std::string(argv[i]) == "--reg-args") options.regArgs = true;
+		if (std::string(argv[i]) == "--omit-fp") options.omitFp = true;
+		if (std::string(argv[i]) == "-Os") options.size = true;
+		if (std::string(argv[i]) == "--static-frames") options.staticFrames = true;
+		if (std::string(argv[i]) == "--profile-use" && i + 1 < argc) {
+			std::ifstream profile(argv[++i]);
+			if (!profile) {
+				std::cerr << "ERROR: Cannot read profile " << argv[i] << std::endl;
+				return 1;
+			}
+			tree.readProfile(profile);
+		}
+		if (std::string(argv[i]) == "--cycle-model" && i + 1 < argc) {
+			std::ifstream model(argv[++i]);
+			if (!model || !options.cycles.read(model)) {
+				std::cerr << "ERROR: Cannot read cycle model " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+	}
 
 	// initialize the wlp4 CFG
 	std::istringstream in(WLP4_CFG);
@@ -867,6 +3380,16 @@ int main() {
 	}
 
 	// read in the parse tree, annotate, then output
+	tree.setOptions(options);
 	std::cin >> tree;
-	tree.generate(std::cout);
+	OutputSink sink(std::cout);
+	std::ostream out(&sink);
+	try {
+		tree.generate(out);
+	} catch (AssemblerException &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	sink.flush();
+	if (showStats) tree.printStats(std::cerr);
 }
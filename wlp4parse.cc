@@ -4,20 +4,7 @@
 #include <vector>
 #include <map>
 #include "wlp4data.h"
-
-std::string DIR_CFG = ".CFG";
-std::string DIR_DERIVATIONS = ".DERIVATION";
-std::string DIR_INPUT = ".INPUT";
-std::string DIR_ACTIONS = ".ACTIONS";
-std::string DIR_TRANSITIONS = ".TRANSITIONS";
-std::string DIR_REDUCTIONS = ".REDUCTIONS";
-std::string DIR_END = ".END";
-std::string DIR_EMPTY = ".EMPTY";
-std::string DIR_ACCEPT = ".ACCEPT";
-std::string STR_BOF = "BOF";
-std::string STR_EOF = "EOF";
-
-
+#include "wlp4sink.h"
 
 
 // S := State name type, T:= Transition type
@@ -152,7 +139,7 @@ class WLP4Parser : public DFA<int,std::string> {
 	struct Token {
 		std::string kind;
 		std::string lexeme;
-		Token(std::string &kind, std::string &lexeme) : kind(kind), lexeme(lexeme) {}
+		Token(const std::string &kind, const std::string &lexeme) : kind(kind), lexeme(lexeme) {}
 	};
 
 	struct Node {
@@ -212,7 +199,7 @@ class WLP4Parser : public DFA<int,std::string> {
 				out << ' ' << DIR_EMPTY;
 			}
 		}
-		out << std::endl;
+		out << '\n';
 		for (Node *child : node->children)
 			print(out, child);
 		return out;
@@ -338,5 +325,8 @@ int main() {
 
 	while (getline(std::cin, str))
 		input += str + '\n';
-	parser.parse(input);
+	OutputSink sink(std::cout);
+	std::ostream out(&sink);
+	parser.parse(input, out);
+	sink.flush();
 }
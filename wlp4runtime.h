@@ -0,0 +1,323 @@
+#ifndef WLP4RUNTIME_H
+#define WLP4RUNTIME_H
+#include <string>
+
+/** Runtime routines shipped with the compiler, in the MIPS subset the assembler accepts, and **/
+/** bundled into the program by wlp4gen --runtime (in place of importing them) **/
+/** all of them rely on $4 holding 4, as generated code keeps it **/
+
+// Heap - init, new and delete, as called by generated code:
+//  - init: $1 and $2 as wain received them ($2 zeroed unless wain takes an array)
+//  - new:  $1 the number of words, $3 the block (0 if out of memory)
+//  - delete: $1 the block (never NULL)
+// every register but $3 is preserved
+//
+// each block has a header and a footer word, both holding the block size in bytes (payload + 8),
+// negated while the block is on the large free list; blocks of at most 16 words are recycled on
+// free lists of their exact size (O(1) new and delete, never coalesced), larger ones are taken
+// first-fit from one doubly-linked free list (next and prev after the header, split if the rest
+// can form a block of its own), coalesced with free neighbours on delete, and given back to the
+// untouched top of the heap when they end there; fresh blocks are cut from the top, which grows
+// towards the stack (keeping 64 bytes clear of the stack pointer)
+//
+// in arena mode, generated code bumps the top itself while it stays below the arena limit
+// (calling new past it), and never calls delete
+//
+// rt_heap data: 0 heap start, 4 top, 8 large free list, 12 arena limit, 12+4n free list of
+// blocks of n words (n > 0)
+const std::string WLP4_RUNTIME_HEAP = R"END(
+init:
+		sw $1, -4($30)
+		sw $2, -8($30)
+		lis $3
+		.word rt_end
+		beq $2, $0, rt_init_base		; no array - the heap starts after the program
+		add $3, $2, $2
+		add $3, $3, $3
+		add $3, $1, $3					; otherwise after the array
+rt_init_base:
+		lis $1
+		.word rt_heap
+		sw $3, 0($1)
+		sw $3, 4($1)
+		sw $0, 8($1)
+		lis $3
+		.word 0x100000
+		sub $3, $30, $3
+		sw $3, 12($1)					; arena limit - 1 MiB below the stack
+		beq $0, $0, rt_exit_fast
+
+new:
+		sw $1, -4($30)
+		sw $2, -8($30)
+		slt $3, $0, $1
+		beq $3, $0, rt_exit_fast		; nothing to allocate - $3 is 0
+		lis $2
+		.word 17
+		slt $3, $1, $2
+		add $1, $1, $1
+		add $1, $1, $1					; payload bytes
+		lis $2
+		.word rt_heap
+		beq $3, $0, rt_new_large
+		add $2, $2, $1
+		lw $3, 12($2)					; free list of the size
+		beq $3, $0, rt_new_small_top
+		lw $1, 0($3)
+		sw $1, 12($2)					; pop
+		beq $0, $0, rt_exit_fast
+rt_new_small_top:
+		sub $2, $2, $1
+		sw $5, -12($30)
+		sw $6, -16($30)
+		sw $7, -20($30)
+		add $6, $1, $4
+		add $6, $6, $4					; block bytes
+		beq $0, $0, rt_new_top
+
+rt_new_large:
+		sw $5, -12($30)
+		sw $6, -16($30)
+		sw $7, -20($30)
+		add $6, $1, $4
+		add $6, $6, $4					; block bytes
+		lw $3, 8($2)
+rt_fit_loop:
+		beq $3, $0, rt_new_top			; no free block fits
+		lw $5, 0($3)
+		sub $5, $0, $5
+		slt $7, $5, $6
+		beq $7, $0, rt_fit_found
+		lw $3, 4($3)
+		beq $0, $0, rt_fit_loop
+rt_fit_found:
+		lw $1, 4($3)					; unlink it
+		lw $7, 8($3)
+		bne $7, $0, rt_fit_unlink_prev
+		sw $1, 8($2)
+		beq $0, $0, rt_fit_unlink_next
+rt_fit_unlink_prev:
+		sw $1, 4($7)
+rt_fit_unlink_next:
+		beq $1, $0, rt_fit_split
+		sw $7, 8($1)
+rt_fit_split:
+		sub $5, $5, $6					; bytes left over
+		lis $7
+		.word 16
+		slt $7, $5, $7
+		bne $7, $0, rt_fit_whole
+		sw $6, 0($3)
+		add $1, $3, $6
+		sw $6, -4($1)
+		sub $7, $0, $5					; the rest becomes a free block
+		sw $7, 0($1)
+		add $5, $1, $5
+		sw $7, -4($5)
+		lw $7, 8($2)
+		sw $7, 4($1)
+		sw $0, 8($1)
+		beq $7, $0, rt_fit_link
+		sw $1, 8($7)
+rt_fit_link:
+		sw $1, 8($2)
+		beq $0, $0, rt_new_done
+rt_fit_whole:
+		add $5, $5, $6
+		sw $5, 0($3)
+		add $1, $3, $5
+		sw $5, -4($1)
+		beq $0, $0, rt_new_done
+
+rt_new_top:
+		lw $3, 4($2)					; $6 bytes from the top
+		add $5, $3, $6
+		lis $7
+		.word 64
+		add $7, $5, $7
+		sltu $7, $7, $30
+		bne $7, $0, rt_new_top_fits
+		add $3, $0, $0					; out of memory
+		beq $0, $0, rt_exit
+rt_new_top_fits:
+		sw $5, 4($2)
+		sw $6, 0($3)
+		sw $6, -4($5)
+rt_new_done:
+		add $3, $3, $4
+		beq $0, $0, rt_exit
+
+delete:
+		sw $1, -4($30)
+		sw $2, -8($30)
+		lw $3, -4($1)					; block bytes
+		lis $2
+		.word 73
+		slt $2, $3, $2
+		beq $2, $0, rt_delete_large
+		lis $2
+		.word rt_heap
+		add $2, $2, $3
+		lw $3, 4($2)					; push on the free list of the size
+		sw $3, 0($1)
+		sw $1, 4($2)
+		beq $0, $0, rt_exit_fast
+
+rt_delete_large:
+		sw $5, -12($30)
+		sw $6, -16($30)
+		sw $7, -20($30)
+		lis $2
+		.word rt_heap
+		sub $1, $1, $4					; header
+		add $5, $1, $3
+		lw $6, 4($2)
+		beq $5, $6, rt_delete_prev		; last block
+		lw $6, 0($5)
+		slt $7, $6, $0
+		beq $7, $0, rt_delete_prev		; next block in use
+		sub $3, $3, $6					; merge the next block
+		lw $6, 4($5)
+		lw $7, 8($5)
+		bne $7, $0, rt_delete_next_prev
+		sw $6, 8($2)
+		beq $0, $0, rt_delete_next_next
+rt_delete_next_prev:
+		sw $6, 4($7)
+rt_delete_next_next:
+		beq $6, $0, rt_delete_prev
+		sw $7, 8($6)
+rt_delete_prev:
+		lw $6, 0($2)
+		beq $1, $6, rt_delete_top		; first block
+		lw $6, -4($1)
+		slt $7, $6, $0
+		beq $7, $0, rt_delete_top		; previous block in use
+		add $1, $1, $6					; merge into the previous block
+		sub $3, $3, $6
+		lw $6, 4($1)
+		lw $7, 8($1)
+		bne $7, $0, rt_delete_prev_prev
+		sw $6, 8($2)
+		beq $0, $0, rt_delete_prev_next
+rt_delete_prev_prev:
+		sw $6, 4($7)
+rt_delete_prev_next:
+		beq $6, $0, rt_delete_top
+		sw $7, 8($6)
+rt_delete_top:
+		add $5, $1, $3
+		lw $6, 4($2)
+		bne $5, $6, rt_delete_free
+		sw $1, 4($2)					; back to the top of the heap
+		beq $0, $0, rt_exit
+rt_delete_free:
+		sub $6, $0, $3
+		sw $6, 0($1)
+		sw $6, -4($5)
+		lw $7, 8($2)
+		sw $7, 4($1)
+		sw $0, 8($1)
+		beq $7, $0, rt_delete_link
+		sw $1, 8($7)
+rt_delete_link:
+		sw $1, 8($2)
+
+rt_exit:
+		lw $5, -12($30)
+		lw $6, -16($30)
+		lw $7, -20($30)
+rt_exit_fast:
+		lw $1, -4($30)
+		lw $2, -8($30)
+		jr $31
+
+rt_heap:
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+		.word 0
+rt_end:
+)END";
+
+// Print - print, as called by generated code: $1 the integer, written in decimal and followed
+// by a newline to the output device (0xffff000c); only $1, $2, $3 and $5 are changed, which
+// generated code never keeps live across a print - so the body is also inlined as it is, with
+// its rt_print_ labels renamed
+//
+// the magnitude is split into pairs of digits by dividing by 100 (pairs pushed below the stack
+// pointer), then each pair is written by looking up its two characters in rt_digits (tens for
+// 0..99, then ones 400 bytes further) - one division per two digits
+const std::string WLP4_RUNTIME_PRINT_BODY = R"END(
+		lis $5
+		.word 0xffff000c
+		add $2, $30, $0
+		slt $3, $1, $0
+		beq $3, $0, rt_print_split
+		lis $3
+		.word 45
+		sw $3, 0($5)					; '-'
+		sub $1, $0, $1					; magnitude, read unsigned (so -2^31 is fine)
+rt_print_split:
+		lis $3
+		.word 100
+		divu $1, $3
+		mfhi $3
+		sw $3, -4($2)
+		sub $2, $2, $4
+		mflo $1
+		bne $1, $0, rt_print_split
+		lw $1, 0($2)
+		lis $3
+		.word 10
+		slt $3, $1, $3
+		beq $3, $0, rt_print_pairs
+		lis $3
+		.word 48
+		add $3, $1, $3
+		sw $3, 0($5)					; leading pair below 10 - a single digit
+		add $2, $2, $4
+		beq $2, $30, rt_print_end
+rt_print_pairs:
+		lw $1, 0($2)
+		add $1, $1, $1
+		add $1, $1, $1
+		lis $3
+		.word rt_digits
+		add $1, $1, $3
+		lw $3, 0($1)
+		sw $3, 0($5)
+		lw $3, 400($1)
+		sw $3, 0($5)
+		add $2, $2, $4
+		bne $2, $30, rt_print_pairs
+rt_print_end:
+		lis $3
+		.word 10
+		sw $3, 0($5)					; newline
+)END";
+
+const std::string WLP4_RUNTIME_PRINT = "\nprint:" + WLP4_RUNTIME_PRINT_BODY + "\t\tjr $31\n" + [] {
+	std::string table = "\nrt_digits:\n";
+	for (int k = 0; k < 200; ++k)
+		table += "\t\t.word " + std::to_string('0' + ((k < 100) ? k / 10 : k % 10)) + "\n";
+	return table;
+}();
+
+#endif
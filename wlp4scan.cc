@@ -3,6 +3,7 @@
 #include <string>
 #include <map>
 #include <vector>
+#include "wlp4sink.h"
 const std::string ALPHABET    = ".ALPHABET";
 const std::string STATES      = ".STATES";
 const std::string TRANSITIONS = ".TRANSITIONS";
@@ -95,7 +96,7 @@ class DFA {
 				}
 			}
 			accepted = (curState != nullptr && curState->isAccepting());
-			out << s << ((accepted) ? " true" : " false") << std::endl;
+			out << s << ((accepted) ? " true" : " false") << '\n';
 		}
 	}
 	/** For A4P3 - Simplified Maximal Munch **/
@@ -116,7 +117,7 @@ class DFA {
 					return;
 				}
 				// already assuming no whitespace in s
-				out << lex << std::endl;
+				out << lex << '\n';
 				lex = "";
 				curState = start;
 				if (i == k) return;
@@ -290,7 +291,7 @@ class WLP4Scanner : public DFA {
 						}
 					}
 					if (kind == "COMMENT") break;
-					if (kind != "WHITESPACE") out << kind << ' ' << lex << std::endl;
+					if (kind != "WHITESPACE") out << kind << ' ' << lex << '\n';
 					if (i == k) break;
 
 					lex = "";
@@ -312,5 +313,8 @@ class WLP4Scanner : public DFA {
 // simplified maximal munch algorithm
 int main() {
 	WLP4Scanner scanner;
-	scanner.scanAll();
+	OutputSink sink(std::cout);
+	std::ostream out(&sink);
+	scanner.scanAll(std::cin, out);
+	sink.flush();
 }
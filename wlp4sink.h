@@ -0,0 +1,49 @@
+#ifndef WLP4SINK_H
+#define WLP4SINK_H
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+const std::size_t SINK_BUFFER_SIZE = 1 << 16;		// bytes gathered before passing output on
+
+/** Output sink shared by all stages - gathers output in one reusable buffer, and passes it on to **/
+/** the destination only when full, or on flush() (flushes such as std::endl are otherwise ignored) **/
+class OutputSink : public std::streambuf {
+	std::streambuf *dest;
+	std::vector<char> buffer;
+
+  protected:
+	int_type overflow(int_type ch) override {
+		if (!drain()) return traits_type::eof();
+		if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+			*pptr() = traits_type::to_char_type(ch);
+			pbump(1);
+		}
+		return traits_type::not_eof(ch);
+	}
+
+	int sync() override { return 0; }
+
+	/** pass the gathered output on, emptying the buffer **/
+	bool drain() {
+		std::streamsize n = pptr() - pbase();
+		if (n > 0 && dest->sputn(pbase(), n) != n) return false;
+		setp(buffer.data(), buffer.data() + buffer.size());
+		return true;
+	}
+
+  public:
+	OutputSink(std::ostream &out, std::size_t size = SINK_BUFFER_SIZE) : dest(out.rdbuf()), buffer(size) {
+		setp(buffer.data(), buffer.data() + buffer.size());
+	}
+	OutputSink(const OutputSink &) = delete;
+	~OutputSink() { flush(); }
+
+	/** pass everything on to the destination, and flush it too **/
+	void flush() {
+		drain();
+		dest->pubsync();
+	}
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include <map>
 #include <set>
 #include "wlp4data.h"
+#include "wlp4sink.h"
 
 
 
@@ -155,7 +156,7 @@ class WLP4ParseTree {
 	}
 
 	void printTree(std::ostream &out, Node *node) {
-		out << node->seq << ((node->type == TYPE_NONE) ? "" : " : " + node->type) << std::endl;
+		out << node->seq << ((node->type == TYPE_NONE) ? "" : " : " + node->type) << '\n';
 		for (Node *c : node->children) printTree(out, c);
 	}
 
@@ -543,6 +544,9 @@ int main() {
 	// read in the parse tree, annotate, then output
 	std::cin >> tree;
 	if (tree.annotate()) {
-		std::cout << tree;
+		OutputSink sink(std::cout);
+		std::ostream out(&sink);
+		out << tree;
+		sink.flush();
 	}
 }